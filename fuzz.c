@@ -0,0 +1,968 @@
+// Differential fuzzer and microbenchmark for the optimized kernels of strlib.h.
+// Every kernel is run against a plain reference implementation and the program aborts on the first difference.
+//
+//   libFuzzer: clang -O1 -g -fsanitize=fuzzer,address,undefined -DSTR_FUZZ_LIBFUZZER fuzz.c -o fuzz && ./fuzz
+//   AFL:       afl-clang-fast -O1 -g -fsanitize=address fuzz.c -o fuzz && afl-fuzz -i seeds -o out -- ./fuzz
+//   random:    cc -O1 -g -fsanitize=address,undefined fuzz.c -o fuzz && ./fuzz random 1000000
+//   benchmark: cc -O2 -march=native fuzz.c -o fuzz && ./fuzz bench 1048576
+//
+// Build with and without -march=native (or -mssse3 / -mavx2) to cover both the vector and the scalar paths.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// corrupted packs are the only errors the checks provoke, str_pack_open rejects them quietly; any other error,
+// including the out of memory and NULL allocator asserts, is reported and aborts instead of exiting cleanly
+void fuzz_error(const char *func, const char *msg, ...)
+{
+	if (strcmp(func, "str_pack_open") == 0) return;
+	va_list args;
+	va_start(args, msg);
+	fprintf(stderr, "[ERROR] %s: ", func);
+	vfprintf(stderr, msg, args);
+	fputc('\n', stderr);
+	va_end(args);
+	abort();
+}
+#define str_error(msg, ...) fuzz_error(__func__, msg, ##__VA_ARGS__)
+
+#define STRLIB_IMPLEMENTATION
+#include "strlib.h"
+#include <stdint.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#define FUZZ_GUARD_PAGE
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+
+#define FUZZ_MAX 4096
+#define fuzz_check(state, msg, ...) do{if (!(state)) {fprintf(stderr, "[MISMATCH] %s: " msg "\n", __func__, ##__VA_ARGS__); abort();}} while (0)
+
+// places a copy of the input either at an arbitrary offset of an exact-size allocation or right before a
+// PROT_NONE page, so that every read past the end of a view faults even without a sanitizer
+typedef struct{
+	char *value;
+	void *block;
+} fuzz_view;
+
+fuzz_view fuzz_place(const uint8_t *data, size_t n, uint8_t mode)
+{
+#ifdef FUZZ_GUARD_PAGE
+	// the data pages hold FUZZ_MAX rounded up to whole pages, the guard is the page right after them
+	static char *region = NULL;
+	static size_t data_size = 0;
+	if (region == NULL){
+		long page = sysconf(_SC_PAGESIZE);
+		if (page <= 0) abort();
+		data_size = (FUZZ_MAX + page-1) / page * page;
+		region = mmap(NULL, data_size+page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED || mprotect(region+data_size, page, PROT_NONE) != 0) abort();
+	}
+	if ((mode & 1) && n <= FUZZ_MAX){
+		char *value = region + data_size - n;
+		if (n > 0) memcpy(value, data, n);
+		return (fuzz_view) {.value=value, .block=NULL};
+	}
+#endif // FUZZ_GUARD_PAGE
+	size_t offset = (mode >> 1) & 15;
+	char *block = malloc(offset+n+1);
+	if (block == NULL) abort();
+	if (n > 0) memcpy(block+offset, data, n);
+	return (fuzz_view) {.value=block+offset, .block=block};
+}
+
+// ---- reference implementations ----
+
+int ref_find_str(str s, str q)
+{
+	if (q.len == 0 || q.len > s.len) return STR_NOT_FOUND;
+	for (size_t i=0; i+q.len<=s.len; ++i){
+		if (memcmp(s.value+i, q.value, q.len) == 0) return i;
+	}
+	return STR_NOT_FOUND;
+}
+
+bool ref_in(str chars, char c)
+{
+	return chars.len > 0 && memchr(chars.value, c, chars.len) != NULL;
+}
+
+size_t ref_span(str s, str chars, bool member)
+{
+	size_t i = 0;
+	while (i < s.len && ref_in(chars, s.value[i]) == member) i++;
+	return i;
+}
+
+size_t ref_replace(str s, str a, str b, char *out)
+{
+	size_t w = 0;
+	for (size_t i=0; i<s.len;){
+		if (a.len > 0 && i+a.len <= s.len && memcmp(s.value+i, a.value, a.len) == 0){
+			if (b.len > 0) memcpy(out+w, b.value, b.len);
+			w += b.len;
+			i += a.len;
+		}
+		else out[w++] = s.value[i++];
+	}
+	return w;
+}
+
+int ref_hex_value(unsigned char c)
+{
+	const char *digits = "0123456789abcdef0123456789ABCDEF";
+	const char *p = memchr(digits, c, 32);
+	return p == NULL ? -1 : (p-digits) & 15;
+}
+
+size_t ref_hex_encode(str s, char *out)
+{
+	for (size_t i=0; i<s.len; ++i){
+		out[2*i] = "0123456789abcdef"[(unsigned char) s.value[i] >> 4];
+		out[2*i+1] = "0123456789abcdef"[s.value[i] & 15];
+	}
+	return 2*s.len;
+}
+
+bool ref_hex_decode(str s, char *out, size_t *len)
+{
+	if (s.len % 2 != 0) return false;
+	for (size_t i=0; i<s.len; i+=2){
+		int hi = ref_hex_value(s.value[i]);
+		int lo = ref_hex_value(s.value[i+1]);
+		if (hi < 0 || lo < 0) return false;
+		out[i/2] = hi*16 + lo;
+	}
+	*len = s.len/2;
+	return true;
+}
+
+const char* ref_base64_alphabet(bool url)
+{
+	return url ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+	           : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+size_t ref_base64_encode(str s, bool url, char *out)
+{
+	const char *alphabet = ref_base64_alphabet(url);
+	uint32_t bits = 0;
+	size_t count = 0, w = 0;
+	for (size_t i=0; i<s.len; ++i){
+		bits = (bits << 8) | (unsigned char) s.value[i];
+		count += 8;
+		while (count >= 6){
+			count -= 6;
+			out[w++] = alphabet[(bits >> count) & 63];
+		}
+	}
+	if (count > 0) out[w++] = alphabet[(bits << (6-count)) & 63];
+	while (!url && w % 4 != 0) out[w++] = '=';
+	return w;
+}
+
+bool ref_base64_decode(str s, bool url, char *out, size_t *len)
+{
+	const char *alphabet = ref_base64_alphabet(url);
+	size_t n = s.len, pad = 0;
+	while (pad < 2 && n > 0 && s.value[n-1] == '='){
+		n--;
+		pad++;
+	}
+	if ((pad > 0 || !url) && (n+pad) % 4 != 0) return false;
+	if (n % 4 == 1) return false;
+	uint32_t bits = 0;
+	size_t count = 0, w = 0;
+	for (size_t i=0; i<n; ++i){
+		const char *p = memchr(alphabet, s.value[i], 64);
+		if (p == NULL) return false;
+		bits = (bits << 6) | (p-alphabet);
+		count += 6;
+		if (count >= 8){
+			count -= 8;
+			out[w++] = (bits >> count) & 0xff;
+		}
+	}
+	if ((bits & ((1u << count)-1)) != 0) return false;
+	*len = w;
+	return true;
+}
+
+bool ref_glob(str p, str s)
+{
+	if (p.len == 0) return s.len == 0;
+	unsigned char c = p.value[0];
+	if (c == '*'){
+		while (p.len > 0 && p.value[0] == '*'){
+			p.value++;
+			p.len--;
+		}
+		for (size_t k=0; k<=s.len; ++k){
+			if (ref_glob(p, (str) {.value=s.value+k, .len=s.len-k})) return true;
+		}
+		return false;
+	}
+	if (s.len == 0) return false;
+	unsigned char x = s.value[0];
+	size_t used = 1;
+	bool match = c == x || c == '?';
+	if (c == '\\' && p.len > 1){
+		match = (unsigned char) p.value[1] == x;
+		used = 2;
+	}
+	else if (c == '['){
+		size_t j = 1;
+		bool negate = j < p.len && (p.value[j] == '!' || p.value[j] == '^');
+		if (negate) j++;
+		size_t first = j;
+		bool hit = false;
+		while (j < p.len && (p.value[j] != ']' || j == first)){
+			unsigned char lo = p.value[j++];
+			if (lo == '\\' && j < p.len) lo = p.value[j++];
+			unsigned char hi = lo;
+			if (j+1 < p.len && p.value[j] == '-' && p.value[j+1] != ']'){
+				hi = p.value[j+1];
+				j += 2;
+				if (hi == '\\' && j < p.len) hi = p.value[j++];
+			}
+			if (lo <= x && x <= hi) hit = true;
+		}
+		if (j < p.len){
+			match = hit != negate;
+			used = j+1;
+		}
+		else match = x == '[';
+	}
+	return match && ref_glob((str) {.value=p.value+used, .len=p.len-used}, (str) {.value=s.value+1, .len=s.len-1});
+}
+
+int ref_compare(const void *a, const void *b)
+{
+	const str *x = a;
+	const str *y = b;
+	size_t n = x->len < y->len ? x->len : y->len;
+	int c = n > 0 ? memcmp(x->value, y->value, n) : 0;
+	if (c != 0) return c;
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+// ---- differential checks, each gets a parameter byte and a view of the payload ----
+
+void check_find_str(uint8_t param, str s)
+{
+	size_t k = param % 8 + 1;
+	str q = str_peek(s, s.len > k ? s.len-k : 0, s.len);
+	str hay = str_peek(s, 0, s.len > k ? s.len-k : 0);
+	fuzz_check(str_find_str(hay, q) == ref_find_str(hay, q), "str_find_str");
+	fuzz_check(str_find_str(s, q) == ref_find_str(s, q), "str_find_str");
+}
+
+void check_charset(uint8_t param, str s)
+{
+	size_t k = param % 6;
+	str chars = str_peek(s, 0, k <= s.len ? k : s.len);
+	str_charset set = str_charset_new(chars);
+	for (size_t from=0; from<s.len && from<40; ++from){
+		str v = {.value=s.value+from, .len=s.len-from};
+		size_t span = ref_span(v, chars, true);
+		fuzz_check(str_span(v, set) == span, "str_span at %zu", from);
+		fuzz_check(str_cspan(v, set) == ref_span(v, chars, false), "str_cspan at %zu", from);
+		size_t end = v.len;
+		while (end > span && ref_in(chars, v.value[end-1])) end--;
+		str t = str_trim_set(v, set);
+		fuzz_check(t.value == v.value+span && t.len == end-span, "str_trim_set at %zu", from);
+	}
+	str rest = s;
+	size_t at = 0;
+	str token;
+	while (!str_empty(token = str_next_token(&rest, set))){
+		at += ref_span((str) {.value=s.value+at, .len=s.len-at}, chars, true);
+		size_t len = ref_span((str) {.value=s.value+at, .len=s.len-at}, chars, false);
+		fuzz_check(token.value == s.value+at && token.len == len, "str_next_token at %zu", at);
+		at += len;
+	}
+	fuzz_check(at + ref_span((str) {.value=s.value+at, .len=s.len-at}, chars, true) == s.len, "str_next_token missed a token");
+}
+
+void check_replace(uint8_t param, str s)
+{
+	size_t al = param % 4 + 1;
+	size_t bl = (param >> 2) % 8;
+	if (s.len < al+bl) return;
+	str a = str_peek(s, 0, al);
+	str b = str_peek(s, al, al+bl);
+	str body = str_from(s, al+bl);
+	char *expected = malloc(body.len*(bl+1)+1);
+	size_t n = ref_replace(body, a, b, expected);
+	str_buf buf = str_buf_new(body, param >> 5, malloc, free);
+	str_buf_replace_str_mod(&buf, a, b);
+	fuzz_check(buf.len == n && (n == 0 || memcmp(buf.value, expected, n) == 0) && buf.value[n] == '\0', "str_buf_replace_str_mod");
+	str_free_buf(buf);
+	str_pipeline p = str_pipeline_new(malloc, free);
+	str_pipeline_replace_str(&p, a, b);
+	str out = str_pipeline_run(&p, body, malloc);
+	fuzz_check(out.len == n && (n == 0 || memcmp(out.value, expected, n) == 0), "str_pipeline_replace_str");
+	str_free(out, free);
+	str_free_pipeline(p);
+	free(expected);
+}
+
+// appends, inserts and replaces with views into the buffer itself, cap == len forces every append to grow
+void check_buf(uint8_t param, str s)
+{
+	if (s.len == 0) return;
+	size_t from = (param & 15) % s.len;
+	size_t to = from + ((param >> 4) % (s.len-from+1));
+	size_t index = (param * 7u) % (s.len+1);
+	str part = str_peek(s, from, to);
+	char *expected = malloc(2*s.len+4);
+	memcpy(expected, s.value, s.len);
+	if (part.len > 0) memcpy(expected+s.len, part.value, part.len);
+	str_buf buf = str_buf_new(s, 0, malloc, free);
+	str_buf_append_mod(&buf, str_peek(str_buf_str(buf), from, to));
+	fuzz_check(buf.len == s.len+part.len && memcmp(buf.value, expected, buf.len) == 0 && buf.value[buf.len] == '\0', "str_buf_append_mod");
+	str_free_buf(buf);
+	memcpy(expected, s.value, index);
+	if (part.len > 0) memcpy(expected+index, part.value, part.len);
+	memcpy(expected+index+part.len, s.value+index, s.len-index);
+	buf = str_buf_new(s, param & 1 ? 0 : 2*s.len, malloc, free);
+	str_buf_insert_mod(&buf, str_peek(str_buf_str(buf), from, to), index);
+	fuzz_check(buf.len == s.len+part.len && memcmp(buf.value, expected, buf.len) == 0 && buf.value[buf.len] == '\0', "str_buf_insert_mod");
+	str_free_buf(buf);
+	if (part.len > 0 && part.len <= 4){
+		str a = str_peek(s, from, from+1);
+		char *replaced = malloc(s.len*part.len+1);
+		size_t n = ref_replace(s, a, part, replaced);
+		buf = str_buf_new(s, param & 1 ? 0 : 2*n, malloc, free);
+		str_buf_replace_str_mod(&buf, str_peek(str_buf_str(buf), from, from+1), str_peek(str_buf_str(buf), from, to));
+		fuzz_check(buf.len == n && memcmp(buf.value, replaced, n) == 0 && buf.value[n] == '\0', "str_buf_replace_str_mod");
+		str_free_buf(buf);
+		free(replaced);
+	}
+	size_t width = s.len + param % 5 - 1;
+	size_t pad = width > s.len ? width-s.len : 0;
+	for (int left=0; left<2; ++left){
+		memset(expected+(left ? 0 : s.len), '.', pad);
+		memcpy(expected+(left ? pad : 0), s.value, s.len);
+		buf = str_buf_new(s, param & 1 ? 0 : width, malloc, free);
+		if (left) str_buf_pad_left_mod(&buf, '.', width);
+		else str_buf_pad_right_mod(&buf, '.', width);
+		fuzz_check(buf.len == s.len+pad && memcmp(buf.value, expected, buf.len) == 0 && buf.value[buf.len] == '\0', "str_buf_pad_%s_mod", left ? "left" : "right");
+		str_free_buf(buf);
+	}
+	free(expected);
+}
+
+// the older functions expect zero-terminated strings, as they would get from str() or str_new()
+str fuzz_cstr(str s)
+{
+	char *value = malloc(s.len+1);
+	if (s.len > 0) memcpy(value, s.value, s.len);
+	value[s.len] = '\0';
+	return (str) {.value=value, .len=s.len};
+}
+
+str ref_trim(str s, str t, bool left, bool right)
+{
+	while (left && s.len >= t.len && memcmp(s.value, t.value, t.len) == 0){
+		s.value += t.len;
+		s.len -= t.len;
+	}
+	while (right && s.len >= t.len && memcmp(s.value+s.len-t.len, t.value, t.len) == 0) s.len -= t.len;
+	return s;
+}
+
+bool fuzz_equals(str a, str b)
+{
+	return a.len == b.len && (a.len == 0 || memcmp(a.value, b.value, a.len) == 0) && a.value != NULL && a.value[a.len] == '\0';
+}
+
+void check_legacy(uint8_t param, str s)
+{
+	size_t al = param % 4 + 1;
+	size_t bl = (param >> 2) % 8;
+	if (s.len < al+bl) return;
+	str a = fuzz_cstr(str_peek(s, 0, al));
+	str b = fuzz_cstr((str) {.value=s.value+al, .len=bl});
+	str body = fuzz_cstr(str_from(s, al+bl));
+	char *expected = malloc(body.len*(bl+1)+1);
+	size_t n = ref_replace(body, a, b, expected);
+	str out = str_replace_str(body, a, b, malloc);
+	fuzz_check(fuzz_equals(out, (str) {.value=expected, .len=n}), "str_replace_str");
+	str_free(out, free);
+	for (int side=1; side<=3; ++side){
+		str trimmed = ref_trim(body, a, side & 1, side & 2);
+		out = side == 1 ? str_trim_left_str(body, a, malloc) : side == 2 ? str_trim_right_str(body, a, malloc) : str_trim_str(body, a, malloc);
+		fuzz_check(fuzz_equals(out, trimmed), "str_trim_str on side %d", side);
+		str_free(out, free);
+	}
+	str_array parts = str_split_all_str(body, a, malloc);
+	size_t count = 0, from = 0;
+	for (size_t i=0; body.len > 0 && i<=body.len;){
+		if (i == body.len || (i+a.len <= body.len && memcmp(body.value+i, a.value, a.len) == 0)){
+			fuzz_check(count < parts.count && fuzz_equals(parts.items[count], str_peek(body, from, i)), "str_split_all_str at %zu", count);
+			count++;
+			if (i == body.len) break;
+			i += a.len;
+			from = i;
+		}
+		else i++;
+	}
+	fuzz_check(parts.count == count, "str_split_all_str count");
+	str_free_array(parts, free);
+	free(expected);
+	free(a.value);
+	free(b.value);
+	free(body.value);
+}
+
+void check_hex(uint8_t param, str s)
+{
+	(void) param;
+	char *expected = malloc(2*s.len+1);
+	char *buffer = malloc(2*s.len+1);
+	str e = str_hex_encode(s, malloc);
+	fuzz_check(e.len == ref_hex_encode(s, expected) && memcmp(e.value, expected, e.len) == 0, "str_hex_encode");
+	str d = str_hex_decode(e, malloc);
+	fuzz_check(d.value != NULL && str_equals(d, s), "str_hex_decode round trip");
+	size_t n = 0;
+	bool valid = ref_hex_decode(s, expected, &n);
+	str raw = str_hex_decode(s, malloc);
+	str raw_buffer = str_hex_decode_to_buffer(s, buffer, 2*s.len+1);
+	fuzz_check((raw.value != NULL) == valid && (raw_buffer.value != NULL) == valid, "str_hex_decode validation");
+	fuzz_check(!valid || (raw.len == n && raw_buffer.len == n && memcmp(raw.value, expected, n) == 0 && memcmp(buffer, expected, n) == 0), "str_hex_decode");
+	str_free(e, free);
+	str_free(d, free);
+	str_free(raw, free);
+	free(expected);
+	free(buffer);
+}
+
+void check_base64(uint8_t param, str s)
+{
+	bool url = param & 1;
+	char *expected = malloc(2*s.len+4);
+	char *buffer = malloc(2*s.len+4);
+	str e = str_base64_encode(s, url, malloc);
+	fuzz_check(e.len == ref_base64_encode(s, url, expected) && memcmp(e.value, expected, e.len) == 0, "str_base64_encode");
+	str d = str_base64_decode(e, url, malloc);
+	fuzz_check(d.value != NULL && str_equals(d, s), "str_base64_decode round trip");
+	size_t n = 0;
+	bool valid = ref_base64_decode(s, url, expected, &n);
+	str raw = str_base64_decode(s, url, malloc);
+	str raw_buffer = str_base64_decode_to_buffer(s, url, buffer, 2*s.len+4);
+	fuzz_check((raw.value != NULL) == valid && (raw_buffer.value != NULL) == valid, "str_base64_decode validation");
+	fuzz_check(!valid || (raw.len == n && raw_buffer.len == n && memcmp(raw.value, expected, n) == 0 && memcmp(buffer, expected, n) == 0), "str_base64_decode");
+	str_free(e, free);
+	str_free(d, free);
+	str_free(raw, free);
+	free(expected);
+	free(buffer);
+}
+
+void check_glob(uint8_t param, str s)
+{
+	size_t k = param % 12;
+	if (k > s.len) k = s.len;
+	str pattern = str_peek(s, 0, k);
+	str input = str_from(s, k);
+	if (input.len > 24) input.len = 24;
+	if (str_count(pattern, '*') > 4) return; // keeps the backtracking reference fast
+	str_glob glob = str_glob_compile(pattern, malloc);
+	bool expected = ref_glob(pattern, input);
+	fuzz_check(str_glob_match(&glob, input, NULL) == expected, "str_glob_match");
+	uint64_t *scratch = malloc(glob.words*sizeof(uint64_t));
+	fuzz_check(str_glob_match(&glob, input, scratch) == expected, "str_glob_match with scratch");
+	free(scratch);
+	str_free_glob(glob, free);
+}
+
+// splits the input into views at a delimiter chosen by param
+str* fuzz_split(uint8_t param, str s, size_t *count)
+{
+	char del = "\n, a"[param & 3];
+	size_t n = 1;
+	for (size_t i=0; i<s.len; ++i) n += s.value[i] == del;
+	str *items = malloc(n*sizeof(str));
+	size_t from = 0;
+	*count = 0;
+	for (size_t i=0; i<=s.len; ++i){
+		if (i == s.len || s.value[i] == del){
+			items[(*count)++] = (str) {.value=s.value+from, .len=i-from};
+			from = i+1;
+		}
+	}
+	return items;
+}
+
+void check_sort(uint8_t param, str s)
+{
+	size_t n;
+	str *items = fuzz_split(param, s, &n);
+	str *expected = malloc(n*sizeof(str));
+	memcpy(expected, items, n*sizeof(str));
+	str_array array = {.items=items, .count=n};
+	str_array_sort(&array, malloc, free);
+	qsort(expected, n, sizeof(str), ref_compare);
+	for (size_t i=0; i<n; ++i){
+		fuzz_check(ref_compare(&items[i], &expected[i]) == 0, "str_array_sort at %zu", i);
+	}
+	size_t unique = n > 0;
+	for (size_t i=1; i<n; ++i) unique += ref_compare(&expected[i], &expected[i-1]) != 0;
+	str_array_dedup(&array, NULL);
+	fuzz_check(array.count == unique, "str_array_dedup");
+	memcpy(items, expected, n*sizeof(str));
+	array.count = n;
+	str_array_sort_unique(&array, malloc, free, NULL);
+	fuzz_check(array.count == unique, "str_array_sort_unique");
+	free(items);
+	free(expected);
+}
+
+// serializes the split input and opens it again, then corrupts a header or offset word or truncates the file:
+// str_pack_open has to reject it or every entry has to stay inside the buffer
+void check_pack(uint8_t param, str s)
+{
+	size_t n;
+	str *items = fuzz_split(param, s, &n);
+	str_pack pack = str_pack_from_array((str_array) {.items=items, .count=n}, malloc, free);
+	fuzz_check(pack.count == n, "str_pack_from_array");
+	for (size_t i=0; i<n; ++i){
+		fuzz_check(fuzz_equals(str_pack_at(pack, i), items[i]), "str_pack_at %zu", i);
+	}
+	FILE *file = tmpfile();
+	fuzz_check(file != NULL && str_pack_write(pack, file), "str_pack_write");
+	size_t size = ftell(file);
+	uint64_t *data = malloc(size);
+	rewind(file);
+	fuzz_check(fread(data, 1, size, file) == size, "str_pack_write");
+	fclose(file);
+	str_pack opened = str_pack_open(data, size);
+	fuzz_check(opened.count == n, "str_pack_open");
+	for (size_t i=0; i<n; ++i){
+		fuzz_check(fuzz_equals(str_pack_at(opened, i), items[i]), "str_pack_open entry %zu", i);
+	}
+	size_t word = 1 + (param >> 4) % (size/sizeof(uint64_t)-1);
+	switch ((param >> 2) & 3){
+		case 0: data[word] ^= (uint64_t) 1 << (s.len % 64); break;
+		case 1: data[word] = -(uint64_t) (param+1); break;
+		case 2: data[word] += s.len; break;
+		default: size -= 1 + s.len % size; break;
+	}
+	opened = str_pack_open(data, size);
+	for (size_t i=0; i<opened.count; ++i){
+		str entry = str_pack_at(opened, i);
+		if (entry.value == NULL) continue;
+		fuzz_check(entry.value >= (char*) data && entry.value+entry.len < (char*) data+size && entry.value[entry.len] == '\0', "corrupted str_pack_at %zu", i);
+	}
+	free(data);
+	str_free_pack(pack);
+	free(items);
+}
+
+// queries every split item, a prefix of it and an extension of it against a linear scan over the distinct items
+void check_prefix_index(uint8_t param, str s)
+{
+	size_t n;
+	str *items = fuzz_split(param, s, &n);
+	str *distinct = malloc(n*sizeof(str));
+	memcpy(distinct, items, n*sizeof(str));
+	qsort(distinct, n, sizeof(str), ref_compare);
+	size_t m = 0;
+	for (size_t i=0; i<n; ++i){
+		if (m == 0 || ref_compare(&distinct[i], &distinct[m-1]) != 0) distinct[m++] = distinct[i];
+	}
+	str_prefix_index index = str_prefix_index_new((str_array) {.items=items, .count=n}, malloc, free);
+	fuzz_check(index.count == m, "str_prefix_index_new");
+	for (size_t q=0; q<n && q<32; ++q){
+		str prefix = {.value=items[q].value, .len=(param >> 2) % (items[q].len+1)};
+		size_t count = 0;
+		for (size_t i=0; i<m; ++i) count += str_starts_with_str(distinct[i], prefix);
+		str_array hits = str_prefix_index_find(index, prefix);
+		fuzz_check(hits.count == count && str_prefix_index_count(index, prefix) == count, "str_prefix_index_find");
+		for (size_t i=0; i<hits.count; ++i){
+			fuzz_check(str_starts_with_str(hits.items[i], prefix), "str_prefix_index_find item %zu", i);
+		}
+		size_t end = items[q].value-s.value + items[q].len + (param >> 4);
+		str query = {.value=items[q].value, .len=(end < s.len ? end : s.len) - (items[q].value-s.value)};
+		int longest = STR_NOT_FOUND;
+		for (size_t i=0; i<m; ++i){
+			if (str_starts_with_str(query, distinct[i]) && (longest == STR_NOT_FOUND || distinct[i].len > distinct[longest].len)) longest = i;
+		}
+		int got = str_prefix_index_longest(index, query);
+		fuzz_check(longest == STR_NOT_FOUND ? got == STR_NOT_FOUND : got != STR_NOT_FOUND && ref_compare(&index.items[got], &distinct[longest]) == 0, "str_prefix_index_longest");
+	}
+	str_free_prefix_index(index, free);
+	free(distinct);
+	free(items);
+}
+
+// a chain of one to three trim and per-byte stages against the same sequence of allocating functions,
+// which stop at the first NUL byte, so the input is cut there
+void check_pipeline(uint8_t param, str s)
+{
+	if (s.len < 2) return;
+	char c = s.value[0], r = s.value[1];
+	str body = fuzz_cstr(str_from(s, 2));
+	body.len = strlen(body.value);
+	str expected = str_dup(body, malloc);
+	str_pipeline p = str_pipeline_new(malloc, free);
+	for (size_t k=0; k<1u+(param >> 6)%3u; ++k){
+		str next;
+		switch ((param >> 2*k) & 3){
+			case 0:
+				str_pipeline_trim(&p, str_charset_new((str) {.value=&c, .len=1}));
+				next = str_trim(expected, c, malloc);
+				break;
+			case 1:
+				str_pipeline_to_lower(&p);
+				next = str_to_lower(expected, malloc);
+				break;
+			case 2:
+				str_pipeline_to_upper(&p);
+				next = str_to_upper(expected, malloc);
+				break;
+			default:
+				str_pipeline_remove(&p, r);
+				next = str_remove(expected, r, malloc);
+				break;
+		}
+		str_free(expected, free);
+		expected = next;
+	}
+	str out = str_pipeline_run(&p, body, malloc);
+	fuzz_check(out.len == expected.len && (out.len == 0 || memcmp(out.value, expected.value, out.len) == 0), "str_pipeline_run");
+	str_free(out, free);
+	str_pipeline_run_mod(&p, &body);
+	fuzz_check(body.len == expected.len && (body.len == 0 || memcmp(body.value, expected.value, body.len) == 0), "str_pipeline_run_mod");
+	str_free(expected, free);
+	str_free_pipeline(p);
+	free(body.value);
+}
+
+typedef struct{
+	const char *name;
+	void (*check)(uint8_t param, str s);
+} fuzz_kernel;
+
+// ---- benchmark bodies, each returns something that depends on the whole result ----
+
+size_t bench_find_fast(str s) { return str_find_str(s, str("needle")); }
+size_t bench_find_ref(str s) { return ref_find_str(s, str("needle")); }
+size_t bench_span_fast(str s) { return str_span(s, str_charset_new(str("abcdefghijklmnopqrstuvwxyz "))); }
+size_t bench_span_ref(str s) { return ref_span(s, str("abcdefghijklmnopqrstuvwxyz "), true); }
+
+size_t bench_replace_fast(str s)
+{
+	str_buf buf = str_buf_new(s, 0, malloc, free);
+	str_buf_replace_str_mod(&buf, str("ab"), str("xyz"));
+	size_t n = buf.len;
+	str_free_buf(buf);
+	return n;
+}
+
+size_t bench_replace_ref(str s)
+{
+	char *out = malloc(2*s.len+1);
+	size_t n = ref_replace(s, str("ab"), str("xyz"), out);
+	free(out);
+	return n;
+}
+
+size_t bench_replace_str_fast(str s)
+{
+	str out = str_replace_str(s, str("ab"), str("xyz"), malloc);
+	size_t n = out.len;
+	str_free(out, free);
+	return n;
+}
+
+size_t bench_replace_str_ref(str s)
+{
+	char *out = malloc(2*s.len+1);
+	size_t n = ref_replace(s, str("ab"), str("xyz"), out);
+	free(out);
+	return n;
+}
+
+// both sides copy the result, as str_trim_str does
+size_t bench_trim_fast(str s)
+{
+	str out = str_trim_str(s, str("ab"), malloc);
+	size_t n = out.len;
+	str_free(out, free);
+	return n;
+}
+
+size_t bench_trim_ref(str s)
+{
+	str view = ref_trim(s, str("ab"), true, true);
+	char *out = malloc(view.len+1);
+	memcpy(out, view.value, view.len);
+	out[view.len] = '\0';
+	free(out);
+	return view.len;
+}
+
+size_t bench_split_fast(str s)
+{
+	str_array parts = str_split_all_str(s, str(" "), malloc);
+	size_t n = parts.count;
+	str_free_array(parts, free);
+	return n;
+}
+
+size_t bench_split_ref(str s)
+{
+	size_t count = 1;
+	for (size_t i=0; i<s.len; ++i) count += s.value[i] == ' ';
+	char **parts = malloc(count*sizeof(char*));
+	size_t n = 0, from = 0;
+	for (size_t i=0; i<=s.len; ++i){
+		if (i == s.len || s.value[i] == ' '){
+			parts[n] = malloc(i-from+1);
+			memcpy(parts[n], s.value+from, i-from);
+			parts[n++][i-from] = '\0';
+			from = i+1;
+		}
+	}
+	for (size_t i=0; i<n; ++i) free(parts[i]);
+	free(parts);
+	return n;
+}
+
+size_t bench_hex_fast(str s)
+{
+	str e = str_hex_encode(s, malloc);
+	str d = str_hex_decode(e, malloc);
+	size_t n = e.len + d.len;
+	str_free(e, free);
+	str_free(d, free);
+	return n;
+}
+
+size_t bench_hex_ref(str s)
+{
+	char *e = malloc(2*s.len+1);
+	char *d = malloc(s.len+1);
+	size_t n = 0;
+	ref_hex_decode((str) {.value=e, .len=ref_hex_encode(s, e)}, d, &n);
+	free(e);
+	free(d);
+	return n;
+}
+
+size_t bench_base64_fast(str s)
+{
+	str e = str_base64_encode(s, false, malloc);
+	str d = str_base64_decode(e, false, malloc);
+	size_t n = e.len + d.len;
+	str_free(e, free);
+	str_free(d, free);
+	return n;
+}
+
+size_t bench_base64_ref(str s)
+{
+	char *e = malloc(2*s.len+4);
+	char *d = malloc(s.len+4);
+	size_t n = 0;
+	ref_base64_decode((str) {.value=e, .len=ref_base64_encode(s, false, e)}, false, d, &n);
+	free(e);
+	free(d);
+	return n;
+}
+
+// the backtracking reference is exponential in the number of stars, a single one keeps both sides on the same,
+// linear workload
+size_t bench_glob_fast(str s)
+{
+	str_glob glob = str_glob_compile(str("*zz"), malloc);
+	size_t n = str_glob_match(&glob, s, NULL);
+	str_free_glob(glob, free);
+	return n;
+}
+
+size_t bench_glob_ref(str s)
+{
+	return ref_glob(str("*zz"), s);
+}
+
+size_t bench_sort_fast(str s)
+{
+	str_array array = {.items=malloc((s.len/8+1)*sizeof(str))};
+	for (size_t i=0; i+8<=s.len; i+=8) array.items[array.count++] = (str) {.value=s.value+i, .len=8};
+	str_array_sort(&array, malloc, free);
+	size_t n = array.count > 0 ? (size_t) (array.items[0].value - s.value) : 0;
+	free(array.items);
+	return n;
+}
+
+size_t bench_sort_ref(str s)
+{
+	str *items = malloc((s.len/8+1)*sizeof(str));
+	size_t count = 0;
+	for (size_t i=0; i+8<=s.len; i+=8) items[count++] = (str) {.value=s.value+i, .len=8};
+	qsort(items, count, sizeof(str), ref_compare);
+	size_t n = count > 0 ? (size_t) (items[0].value - s.value) : 0;
+	free(items);
+	return n;
+}
+
+fuzz_kernel kernels[] = {
+	{"find_str", check_find_str},
+	{"charset", check_charset},
+	{"replace", check_replace},
+	{"hex", check_hex},
+	{"base64", check_base64},
+	{"glob", check_glob},
+	{"sort", check_sort},
+	{"buf", check_buf},
+	{"legacy", check_legacy},
+	{"pack", check_pack},
+	{"prefix", check_prefix_index},
+	{"pipeline", check_pipeline},
+};
+#define FUZZ_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+// input layout: kernel selector, parameter, placement mode, payload
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size < 3 || size-3 > FUZZ_MAX) return 0;
+	fuzz_kernel kernel = kernels[data[0] % FUZZ_KERNELS];
+	fuzz_view view = fuzz_place(data+3, size-3, data[2]);
+	kernel.check(data[1], (str) {.value=view.value, .len=size-3});
+	free(view.block);
+	return 0;
+}
+
+#ifndef STR_FUZZ_LIBFUZZER
+uint64_t bench_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec*1000000000u + t.tv_nsec;
+#endif
+}
+
+// random lowercase words
+void bench_text(char *data, size_t size)
+{
+	for (size_t i=0; i<size; ++i){
+		data[i] = "abcdefghijklmnopqrstuvwxyz  "[rand() % 28];
+	}
+}
+
+// text framed by a quarter of repeated "ab" on either side, which str_trim_str has to strip
+void bench_framed(char *data, size_t size)
+{
+	bench_text(data, size);
+	for (size_t i=0; i<size/4; ++i){
+		data[i] = "ab"[i & 1];
+		data[size-1-i] = "ba"[i & 1];
+	}
+}
+
+// ascending unique 8-byte records, the nearly sorted input of a nightly compaction
+void bench_sorted(char *data, size_t size)
+{
+	size_t count = size/8 > 0 ? size/8 : 1;
+	uint64_t step = 208827064576ull / count; // 26^8 distinct records
+	for (size_t i=0; i<size; ++i) data[i] = 'z';
+	for (size_t i=0; i<size/8; ++i){
+		uint64_t v = i*step;
+		for (size_t k=8; k-- > 0; v /= 26) data[8*i+k] = 'a' + v % 26;
+	}
+}
+
+typedef struct{
+	const char *name;
+	void (*input)(char *data, size_t size);
+	size_t (*fast)(str s);
+	size_t (*ref)(str s);
+} fuzz_bench;
+
+fuzz_bench benches[] = {
+	{"find_str", bench_text, bench_find_fast, bench_find_ref},
+	{"span", bench_text, bench_span_fast, bench_span_ref},
+	{"buf_replace", bench_text, bench_replace_fast, bench_replace_ref},
+	{"replace_str", bench_text, bench_replace_str_fast, bench_replace_str_ref},
+	{"trim_str", bench_framed, bench_trim_fast, bench_trim_ref},
+	{"split_all", bench_text, bench_split_fast, bench_split_ref},
+	{"hex", bench_text, bench_hex_fast, bench_hex_ref},
+	{"base64", bench_text, bench_base64_fast, bench_base64_ref},
+	{"glob", bench_text, bench_glob_fast, bench_glob_ref},
+	{"sort", bench_text, bench_sort_fast, bench_sort_ref},
+	{"sort_sorted", bench_sorted, bench_sort_fast, bench_sort_ref},
+};
+#define FUZZ_BENCHES (sizeof(benches)/sizeof(benches[0]))
+
+void bench(size_t size)
+{
+	if (size == 0){
+		fprintf(stderr, "bench needs an input size of at least one byte\n");
+		return;
+	}
+	char *data = malloc(size+1);
+	data[size] = '\0';
+	str s = {.value=data, .len=size};
+#if defined(__x86_64__) || defined(__i386__)
+	printf("%-12s %14s %14s %8s\n", "kernel", "cycles/byte", "ref cycles/byte", "speedup");
+#else
+	printf("%-12s %14s %14s %8s\n", "kernel", "ns/byte", "ref ns/byte", "speedup");
+#endif
+	volatile size_t sink = 0;
+	for (size_t k=0; k<FUZZ_BENCHES; ++k){
+		srand(1);
+		benches[k].input(data, size);
+		double best[2] = {0};
+		size_t (*run[2])(str) = {benches[k].fast, benches[k].ref};
+		for (int r=0; r<2; ++r){
+			for (int rep=0; rep<5; ++rep){
+				uint64_t t = bench_ticks();
+				sink += run[r](s);
+				double per_byte = (double) (bench_ticks()-t) / size;
+				if (rep == 0 || per_byte < best[r]) best[r] = per_byte;
+			}
+		}
+		printf("%-12s %14.3f %14.3f %7.2fx\n", benches[k].name, best[0], best[1], best[1]/best[0]);
+	}
+	(void) sink;
+	free(data);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0){
+		bench(argc > 2 ? strtoul(argv[2], NULL, 10) : 1 << 20);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "random") == 0){
+		size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+		uint8_t input[3+256];
+		srand(argc > 3 ? atoi(argv[3]) : 1);
+		for (size_t i=0; i<iterations; ++i){
+			size_t n = 3 + rand() % 256;
+			// a small alphabet makes matches, separators and valid encodings likely
+			const char *alphabet = (i & 1) ? "ab*?[]!-\\=/+_09AFaf\n, " : NULL;
+			for (size_t k=0; k<n; ++k){
+				input[k] = alphabet != NULL && k >= 3 ? alphabet[rand() % 22] : rand();
+			}
+			LLVMFuzzerTestOneInput(input, n);
+		}
+		printf("%zu inputs passed\n", iterations);
+		return 0;
+	}
+	static uint8_t input[3+FUZZ_MAX];
+	size_t n = fread(input, 1, sizeof(input), stdin);
+	return LLVMFuzzerTestOneInput(input, n);
+}
+#endif // STR_FUZZ_LIBFUZZER
@@ -4,8 +4,15 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdlib.h> // only for exit
+#ifdef __SSSE3__
+	#include <tmmintrin.h>
+#endif // __SSSE3__
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif // __AVX2__
 
 #ifndef ALLOCATOR
 	#define ALLOCATOR
@@ -15,6 +22,8 @@
 
 #define STR_NUMARGS(...)  (sizeof((str[]){ __VA_ARGS__})/sizeof(str))
 #define STR_NOT_FOUND -1
+#define STR_WHITESPACE " \t\n\v\f\r"
+#define STR_GLOB_STACK_WORDS 16 // glob sets of up to 64 times this many states can be matched without scratch
 #define StrAlloc // functions prefixed with this dynamically allocate memory
 #define StrMod // functions prefixed with this modify the content of a given string. Do not provide read-only constants!
 
@@ -24,6 +33,7 @@
 	#define str_info(msg, ...)
 #endif // STR_DEBUG
 
+#ifndef str_error // define str_error before including strlib.h to report errors differently
 #ifdef STR_COLOR_PRINT
 	#define STR_ANSI_RGB(r, g, b) ("\e[38;2;" #r ";" #g ";" #b "m") // set ansi color to rgb value
 	#define STR_ANSI_END "\e[0m" // reset ansi color
@@ -31,6 +41,7 @@
 #else
 	#define str_error(msg, ...) (fprintf(stderr, "[ERROR] %s:%d in %s: " msg "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__))
 #endif // STR_COLOR_PRINT
+#endif // str_error
 
 #define str_assert(state, msg, ...) do{if (!(state)) {str_error(msg, ##__VA_ARGS__); exit(1);}} while (0)
 #define str__assert_alloc(value) str_assert((value)!=NULL, "Out of memory!")
@@ -53,6 +64,79 @@ typedef struct{
     size_t count;
 } str_array;
 
+// mutable string owning its buffer, grows in place with amortized reallocation
+typedef struct{
+    char *value;
+    size_t len;
+    size_t cap; // bytes available for content, excluding the terminating zero
+    Allocator alloc;
+    Deallocator dealloc;
+} str_buf;
+
+// packed string array: one blob holding every string followed by a zero byte, plus an offset table.
+// Serialized by str_pack_write as the header {"STRPACK1", count, size} in native byte order,
+// the count+1 offsets and the blob, which str_pack_open uses in place (e.g. from mmap).
+typedef struct{
+    char *data;
+    uint64_t *offsets; // count+1 entries, string i spans offsets[i] to offsets[i+1]-1
+    size_t count;
+    size_t size;       // used bytes of data
+    size_t data_cap;
+    size_t count_cap;
+    Allocator alloc;
+    Deallocator dealloc; // NULL for packs opened from a serialized buffer
+} str_pack;
+
+// sorted, deduplicated views of a str_array's strings for prefix queries.
+// The index does not copy the strings, they have to outlive it.
+typedef struct{
+    str *items;
+    size_t *parent; // index of the longest item that is a proper prefix of items[i], SIZE_MAX if none
+    size_t count;
+} str_prefix_index;
+
+// 256-bit byte class: bit (c>>4)&7 of bits[(c&15) + 16*(c>>7)] is set for every member c.
+// This nibble layout doubles as the lookup table of the SSSE3 shuffle classifier.
+typedef struct{
+    uint8_t bits[32];
+} str_charset;
+
+// one step of a str_pipeline, including its streaming state
+typedef struct{
+    int kind;
+    int16_t map[256]; // byte map, -1 removes the byte
+    str a;            // replaced needle
+    str b;            // replacement
+    size_t *fail;     // KMP failure table of a
+    str_charset set;  // trimmed bytes
+    size_t matched;
+    bool started;
+    char *held;       // trailing trim candidates
+    size_t held_len;
+    size_t held_cap;
+} str_pipeline_stage;
+
+// sequence of transformations applied in a single streaming pass
+typedef struct{
+    str_pipeline_stage *stages;
+    size_t count;
+    size_t cap;
+    Allocator alloc;
+    Deallocator dealloc;
+} str_pipeline;
+
+// compiled glob pattern(s), matched as a bit-parallel NFA in a single pass over the input
+// the tables are read-only while matching, the state set comes from the caller's scratch of words entries
+typedef struct{
+    uint64_t *step;  // per byte: states that advance on it
+    uint64_t *loop;  // per byte: states that stay on it ('*')
+    uint64_t *star;  // states with an epsilon move to the next state
+    uint64_t *start;
+    size_t *finals;  // final state of each pattern
+    size_t words;
+    size_t count;
+} str_glob;
+
 size_t strlib_len(char *s);
 char* strlib_ncpy(char *s, size_t n, char *d);
 char* strlib_dup(char *s, Allocator alloc);
@@ -85,6 +169,25 @@ StrAlloc str str_trim_str(str string, str s, Allocator alloc);
 StrAlloc str str_merge(str_array strings, Allocator alloc);
 StrAlloc str str_join(str_array strings, char delimiter, Allocator alloc);
 StrAlloc str str_join_str(str_array strings, str delimiter, Allocator alloc);
+StrAlloc str_array* str_array_sort(str_array *array, Allocator alloc, Deallocator dealloc);
+StrAlloc str_array* str_array_sort_unique(str_array *array, Allocator alloc, Deallocator dealloc, Deallocator item_dealloc);
+StrAlloc str_prefix_index str_prefix_index_new(str_array array, Allocator alloc, Deallocator dealloc);
+StrAlloc str str_hex_encode(str data, Allocator alloc);
+StrAlloc str str_hex_decode(str hex, Allocator alloc);
+StrAlloc str str_base64_encode(str data, bool url, Allocator alloc);
+StrAlloc str str_base64_decode(str base64, bool url, Allocator alloc);
+StrAlloc str_pipeline str_pipeline_new(Allocator alloc, Deallocator dealloc);
+StrAlloc str_pipeline* str_pipeline_to_upper(str_pipeline *pipeline);
+StrAlloc str_pipeline* str_pipeline_to_lower(str_pipeline *pipeline);
+StrAlloc str_pipeline* str_pipeline_replace(str_pipeline *pipeline, char a, char b);
+StrAlloc str_pipeline* str_pipeline_replace_str(str_pipeline *pipeline, str a, str b);
+StrAlloc str_pipeline* str_pipeline_remove(str_pipeline *pipeline, char c);
+StrAlloc str_pipeline* str_pipeline_remove_str(str_pipeline *pipeline, str s);
+StrAlloc str_pipeline* str_pipeline_trim(str_pipeline *pipeline, str_charset set);
+StrAlloc str str_pipeline_run(str_pipeline *pipeline, str string, Allocator alloc);
+StrAlloc str_array str_pipeline_run_array(str_pipeline *pipeline, str_array strings, Allocator alloc);
+StrAlloc str_glob str_glob_compile(str pattern, Allocator alloc);
+StrAlloc str_glob str_glob_compile_set(str_array patterns, Allocator alloc);
 
 // functions that modify a string's content, return the given string pointer
 StrMod str* str_to_upper_mod(str *string);
@@ -93,8 +196,31 @@ StrMod str* str_replace_mod(str *string, char a, char b);
 StrMod str* str_replace_str_mod(str *string, str a, str b);
 StrMod str* str_remove_mod(str *string, char c);
 StrMod str* str_remove_str_mod(str *string, str s);
+StrMod str* str_pipeline_run_mod(str_pipeline *pipeline, str *string);
+
+// functions on a str_buf, these grow the buffer through its allocator when needed
+StrAlloc str_buf str_buf_new(str s, size_t cap, Allocator alloc, Deallocator dealloc);
+StrAlloc str_buf* str_buf_reserve(str_buf *buf, size_t cap);
+StrAlloc StrMod str_buf* str_buf_append_mod(str_buf *buf, str s);
+StrAlloc StrMod str_buf* str_buf_insert_mod(str_buf *buf, str s, size_t index);
+StrAlloc StrMod str_buf* str_buf_replace_str_mod(str_buf *buf, str a, str b);
+StrAlloc StrMod str_buf* str_buf_pad_left_mod(str_buf *buf, char c, size_t width);
+StrAlloc StrMod str_buf* str_buf_pad_right_mod(str_buf *buf, char c, size_t width);
+
+// functions on a str_pack
+StrAlloc str_pack str_pack_new(Allocator alloc, Deallocator dealloc);
+StrAlloc str_pack str_pack_from_array(str_array array, Allocator alloc, Deallocator dealloc);
+StrAlloc str_array str_pack_to_array(str_pack pack, Allocator alloc);
+StrAlloc str_pack* str_pack_push(str_pack *pack, str s);
+str str_pack_at(str_pack pack, size_t index);
+bool str_pack_write(str_pack pack, FILE *file);
+str_pack str_pack_open(void *data, size_t size);
 
 char *str_to_buffer(str s, char *buffer, size_t buffer_size);
+str str_hex_encode_to_buffer(str data, char *buffer, size_t buffer_size);
+str str_hex_decode_to_buffer(str hex, char *buffer, size_t buffer_size);
+str str_base64_encode_to_buffer(str data, bool url, char *buffer, size_t buffer_size);
+str str_base64_decode_to_buffer(str base64, bool url, char *buffer, size_t buffer_size);
 int str_find(str string, char c);
 int str_find_str(str string, str query);
 bool str_contains(str string, char c);
@@ -110,15 +236,40 @@ str str_from(str string, size_t from);
 str str_peek(str string, size_t from, size_t to);
 size_t str_count(str string, char c);
 size_t str_count_str(str string, str s);
+bool str_glob_match(const str_glob *glob, str string, uint64_t *scratch);
+size_t str_glob_match_set(const str_glob *glob, str string, uint64_t *scratch, size_t *ids, size_t max_ids);
+str_charset str_charset_new(str chars);
+bool str_charset_has(str_charset set, char c);
+size_t str_span(str string, str_charset set);
+size_t str_cspan(str string, str_charset set);
+int str_find_first_of(str string, str chars);
+int str_find_first_not_of(str string, str chars);
+str str_trim_left_set(str string, str_charset set);
+str str_trim_right_set(str string, str_charset set);
+str str_trim_set(str string, str_charset set);
+str str_strip_chars(str string, str chars);
+str str_next_token(str *rest, str_charset delimiters);
+str_array* str_array_dedup(str_array *array, Deallocator dealloc);
+size_t str_prefix_index_count(str_prefix_index index, str prefix);
+str_array str_prefix_index_find(str_prefix_index index, str prefix);
+int str_prefix_index_longest(str_prefix_index index, str query);
 
 // use these functions when manually freeing allocated memory
 void str_free(str string, Deallocator dealloc);
 void str_free_pair(str_pair pair, Deallocator dealloc);
 void str_free_array(str_array array, Deallocator dealloc);
+void str_free_glob(str_glob glob, Deallocator dealloc);
+void str_free_pipeline(str_pipeline pipeline);
+void str_free_prefix_index(str_prefix_index index, Deallocator dealloc);
+void str_free_buf(str_buf buf);
+void str_free_pack(str_pack pack);
 
 void str_print_array(str_array arr);
 
 void* str__alloc(Allocator alloc, size_t n);
+void* str__realloc(Allocator alloc, Deallocator dealloc, void *p, size_t n, size_t new_n);
+str str__copy(str view, Allocator alloc);
+size_t str__count_str_disjoint(str string, str s);
 
 #define str(s) (str){.value=(s), .len=strlib_len((s))}
 #define str_array(...) ((str_array){.items=((str[]){__VA_ARGS__}), .count=STR_NUMARGS(__VA_ARGS__)})
@@ -127,6 +278,7 @@ void* str__alloc(Allocator alloc, size_t n);
 #define str_print_pair(str_pair) (printf("(\"%s\", \"%s\")\n", (str_pair).a.value, (str_pair).b.value))
 #define str_at(str, i) ((str).value[(i)])
 #define str_empty(str) ((str).len == 0)
+#define str_buf_str(buf) ((str){.value=(buf).value, .len=(buf).len})
 
 #endif // _STRLIB_H
 
@@ -166,6 +318,7 @@ char* strlib_dup(char *s, Allocator alloc)
 	while (*s != '\0'){
 		*d++ = *s++;
 	}
+	*d = '\0';
 	return string;
 }
 
@@ -202,7 +355,8 @@ str str_new(char *s, Allocator alloc)
 str str_dup(str string, Allocator alloc)
 {
 	str__assert_allocator(alloc);
-	return (str) {.value=strlib_dup(string.value, alloc), .len=string.len};
+	if (string.value == NULL) return (str) {0};
+	return str__copy(string, alloc);
 }
 
 char* str_to_buffer(str s, char *buffer, size_t buffer_size)
@@ -290,12 +444,12 @@ str_array str_split_all_str(str string, str del, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.len == 0 || string.value == NULL) return (str_array) {0};
-    size_t count = str_count_str(string, del);
+    size_t count = str__count_str_disjoint(string, del);
     str *array = str__alloc(alloc, (count+1)*sizeof(str));
     char *r = string.value;
     char *w;
     for (size_t i=0; i<count; ++i){
-        int size = str_find_str(str(r), del);
+        int size = str_find_str(str_from(string, r-string.value), del);
         if (size == STR_NOT_FOUND){
             str_error("string was changed during runtime!");
             return (str_array) {0};
@@ -341,7 +495,7 @@ bool str_starts_with_str(str base, str start)
 bool str_ends_with_str(str base, str end)
 {
 	if (end.len > base.len) return false;
-	size_t offset = end.len - base.len;
+	size_t offset = base.len - end.len;
 	for (size_t i=0; i<end.len; ++i){
 		if (base.value[offset+i] != end.value[i]) return false;
 	}
@@ -457,7 +611,7 @@ str* str_replace_str_mod(str *string, str a, str b)
 {
     if (string == NULL) return NULL;
 	if (b.len > a.len){
-		str_error("cannot replace string of length %u with string of length %u!", a.len, b.len);
+		str_error("cannot replace string of length %zu with string of length %zu, use str_buf_replace_str_mod!", a.len, b.len);
 		return string;
 	}
 	size_t count = str_count_str(*string, a);
@@ -496,24 +650,20 @@ str str_replace(str string, char a, char b, Allocator alloc)
 str str_replace_str(str string, str a, str b, Allocator alloc)
 {
 	str__assert_allocator(alloc);
-	size_t count = str_count_str(string, a);
+	size_t count = str__count_str_disjoint(string, a);
 	if (count == 0) return str_dup(string, alloc);
-	size_t delta = b.len - a.len;
-	size_t length = string.len + delta*count;
+	size_t length = string.len - count*a.len + count*b.len;
 	char *value = str__alloc(alloc, length+1);
 	char *w = value;
-	char *r = string.value;
+	size_t r = 0;
 	for (size_t i=0; i<count; ++i){
-		char *n = r + str_find_str(str(r), a);
-		if (n-r > 0){
-			w = strlib_ncpy(r, n-r, w);
-		}
+		size_t n = r + str_find_str(str_from(string, r), a);
+		w = strlib_ncpy(string.value+r, n-r, w);
 		w = strlib_ncpy(b.value, b.len, w);
 		r = n+a.len;
 	}
-	if (r-string.value < length){
-		strlib_ncpy(r, length-(r-string.value), w);
-	}
+	w = strlib_ncpy(string.value+r, string.len-r, w);
+	*w = '\0';
 	return (str) {.value=value, .len=length};
 }
 
@@ -664,98 +814,627 @@ str* str_to_lower_mod(str *string)
     return string;
 }
 
+void str__move(char *s, size_t n, char *d)
+{
+    if (s == NULL || d == NULL || s == d) return;
+    if (d < s){
+        strlib_ncpy(s, n, d);
+        return;
+    }
+    while (n-- > 0){
+        d[n] = s[n];
+    }
+}
+
+size_t str__count_str_disjoint(str string, str s)
+{
+    if (s.len == 0) return 0;
+    size_t count = 0;
+    size_t index = 0;
+    int i;
+    while ((i = str_find_str(str_from(string, index), s)) != STR_NOT_FOUND){
+        count++;
+        index += i+s.len;
+    }
+    return count;
+}
+
+str_buf str_buf_new(str s, size_t cap, Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    if (cap < s.len) cap = s.len;
+    char *value = str__alloc(alloc, cap+1);
+    strlib_ncpy(s.value, s.len, value);
+    return (str_buf) {.value=value, .len=s.len, .cap=cap, .alloc=alloc, .dealloc=dealloc};
+}
+
+str_buf* str_buf_reserve(str_buf *buf, size_t cap)
+{
+    if (buf == NULL) return NULL;
+    if (cap <= buf->cap && buf->value != NULL) return buf;
+    str__assert_allocator(buf->alloc);
+    str__assert_deallocator(buf->dealloc);
+    if (cap < 2*buf->cap) cap = 2*buf->cap;
+    if (cap < 16) cap = 16;
+    char *value = str__alloc(buf->alloc, cap+1);
+    if (buf->value != NULL){
+        strlib_ncpy(buf->value, buf->len, value);
+        buf->dealloc(buf->value);
+    }
+    buf->value = value;
+    buf->cap = cap;
+    return buf;
+}
+
+// whether s is a view into the content of buf, reserving or moving would invalidate it
+bool str__buf_owns(str_buf *buf, str s)
+{
+    return buf->value != NULL && s.len > 0 && s.value >= buf->value && s.value < buf->value+buf->len;
+}
+
+str_buf* str_buf_append_mod(str_buf *buf, str s)
+{
+    if (buf == NULL) return NULL;
+    bool owned = str__buf_owns(buf, s);
+    size_t offset = owned ? (size_t)(s.value-buf->value) : 0;
+    str_buf_reserve(buf, buf->len+s.len);
+    if (owned) s.value = buf->value+offset;
+    char *w = strlib_ncpy(s.value, s.len, buf->value+buf->len);
+    *w = '\0';
+    buf->len += s.len;
+    return buf;
+}
+
+str_buf* str_buf_insert_mod(str_buf *buf, str s, size_t index)
+{
+    if (buf == NULL) return NULL;
+    if (index > buf->len) return buf;
+    bool owned = str__buf_owns(buf, s);
+    size_t offset = owned ? (size_t)(s.value-buf->value) : 0;
+    str_buf_reserve(buf, buf->len+s.len);
+    str__move(buf->value+index, buf->len-index, buf->value+index+s.len);
+    if (owned){
+        // the part of s before index stayed in place, the rest moved along with the tail
+        size_t head = offset >= index ? 0 : (index-offset < s.len ? index-offset : s.len);
+        strlib_ncpy(buf->value+offset, head, buf->value+index);
+        strlib_ncpy(buf->value+offset+head+s.len, s.len-head, buf->value+index+head);
+    }
+    else{
+        strlib_ncpy(s.value, s.len, buf->value+index);
+    }
+    buf->len += s.len;
+    buf->value[buf->len] = '\0';
+    return buf;
+}
+
+str_buf* str_buf_replace_str_mod(str_buf *buf, str a, str b)
+{
+    if (buf == NULL) return NULL;
+    if (buf->value == NULL || a.len == 0) return buf;
+    size_t count = str__count_str_disjoint(str_buf_str(*buf), a);
+    if (count == 0) return buf;
+    if (str__buf_owns(buf, a) || str__buf_owns(buf, b)){
+        // views into buf would be overwritten while the result is built, replace with copies instead
+        str__assert_allocator(buf->alloc);
+        str ca = str__buf_owns(buf, a) ? str__copy(a, buf->alloc) : a;
+        str cb = str__buf_owns(buf, b) ? str__copy(b, buf->alloc) : b;
+        str_buf_replace_str_mod(buf, ca, cb);
+        if (ca.value != a.value) str_free(ca, buf->dealloc);
+        if (cb.value != b.value) str_free(cb, buf->dealloc);
+        return buf;
+    }
+    size_t length = buf->len - count*a.len + count*b.len;
+    char *src = buf->value;
+    char *old = NULL;
+    if (length > buf->cap){
+        // build the result straight into the grown buffer
+        old = buf->value;
+        size_t cap = length < 2*buf->cap ? 2*buf->cap : length;
+        buf->value = str__alloc(buf->alloc, cap+1);
+        buf->cap = cap;
+    }
+    else if (length > buf->len){
+        // move the content to the end once, the write cursor can then never overtake the read cursor
+        src = buf->value + length - buf->len;
+        str__move(buf->value, buf->len, src);
+    }
+    str source = {.value=src, .len=buf->len};
+    char *w = buf->value;
+    size_t r = 0;
+    for (size_t i=0; i<count; ++i){
+        size_t n = r + str_find_str(str_from(source, r), a);
+        w = strlib_ncpy(src+r, n-r, w);
+        w = strlib_ncpy(b.value, b.len, w);
+        r = n+a.len;
+    }
+    w = strlib_ncpy(src+r, source.len-r, w);
+    *w = '\0';
+    buf->len = length;
+    if (old != NULL) buf->dealloc(old);
+    return buf;
+}
+
+str_buf* str_buf_pad_left_mod(str_buf *buf, char c, size_t width)
+{
+    if (buf == NULL) return NULL;
+    if (buf->len >= width) return buf;
+    size_t n = width - buf->len;
+    str_buf_reserve(buf, width);
+    str__move(buf->value, buf->len, buf->value+n);
+    strlib_memset(buf->value, c, n);
+    buf->len = width;
+    buf->value[width] = '\0';
+    return buf;
+}
+
+str_buf* str_buf_pad_right_mod(str_buf *buf, char c, size_t width)
+{
+    if (buf == NULL) return NULL;
+    if (buf->len >= width) return buf;
+    str_buf_reserve(buf, width);
+    strlib_memset(buf->value+buf->len, c, width-buf->len);
+    buf->len = width;
+    buf->value[width] = '\0';
+    return buf;
+}
+
+typedef struct{
+    uint64_t key; // bytes depth to depth+8 of s, big endian and zero padded
+    str s;
+} str__sort_item;
+
+uint64_t str__sort_key(str s, size_t depth)
+{
+    uint64_t key = 0;
+    for (size_t i=depth; i<depth+8; ++i){
+        key = (key << 8) | (i < s.len ? (unsigned char) s.value[i] : 0);
+    }
+    return key;
+}
+
+// compares two strings whose first depth bytes are equal and whose keys are filled for depth
+bool str__sort_less(str__sort_item *a, str__sort_item *b, size_t depth)
+{
+    if (a->key != b->key) return a->key < b->key;
+    size_t length = a->s.len < b->s.len ? a->s.len : b->s.len;
+    for (size_t i=depth+8; i<length; ++i){
+        unsigned char ca = a->s.value[i];
+        unsigned char cb = b->s.value[i];
+        if (ca != cb) return ca < cb;
+    }
+    return a->s.len < b->s.len;
+}
+
+void str__sort_swap(str__sort_item *a, str__sort_item *b)
+{
+    str__sort_item t = *a;
+    *a = *b;
+    *b = t;
+}
+
+uint64_t str__sort_median(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+}
+
+// twice the partitions a balanced quicksort needs, spending them all means the pivots keep failing
+size_t str__sort_budget(size_t n)
+{
+    size_t budget = 0;
+    for (; n > 1; n >>= 1) budget += 2;
+    return budget;
+}
+
+void str__sort_sift(str__sort_item *items, size_t root, size_t n, size_t depth)
+{
+    for (size_t child; (child = 2*root+1) < n; root = child){
+        if (child+1 < n && str__sort_less(&items[child], &items[child+1], depth)) child++;
+        if (!str__sort_less(&items[root], &items[child], depth)) return;
+        str__sort_swap(&items[root], &items[child]);
+    }
+}
+
+// fallback once the partition budget is used up, keeps the sort O(n log n) on adversarial input
+void str__sort_heap(str__sort_item *items, size_t n, size_t depth)
+{
+    for (size_t i=n/2; i-- > 0;) str__sort_sift(items, i, n, depth);
+    for (size_t end=n-1; end>0; --end){
+        str__sort_swap(&items[0], &items[end]);
+        str__sort_sift(items, 0, end, depth);
+    }
+}
+
+void str__sort_depth(str__sort_item *items, size_t n, size_t depth);
+
+// multikey quicksort on the cached keys, equal keys continue 8 bytes deeper
+void str__sort_keyed(str__sort_item *items, size_t n, size_t depth, size_t budget)
+{
+    while (n > 1){
+        if (n <= 16){
+            for (size_t i=1; i<n; ++i){
+                for (size_t j=i; j>0 && str__sort_less(&items[j], &items[j-1], depth); --j){
+                    str__sort_swap(&items[j], &items[j-1]);
+                }
+            }
+            return;
+        }
+        if (budget == 0){
+            str__sort_heap(items, n, depth);
+            return;
+        }
+        budget--;
+        // median of three medians spread over the whole range, which stays close to the true median on
+        // sorted, reversed and sawtooth input where the first, middle and last item alone would not
+        size_t step = n/8;
+        uint64_t pivot = str__sort_median(
+            str__sort_median(items[0].key, items[step].key, items[2*step].key),
+            str__sort_median(items[3*step].key, items[4*step].key, items[5*step].key),
+            str__sort_median(items[6*step].key, items[7*step].key, items[n-1].key));
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt){
+            if (items[i].key < pivot) str__sort_swap(&items[lt++], &items[i++]);
+            else if (items[i].key > pivot) str__sort_swap(&items[i], &items[--gt]);
+            else i++;
+        }
+        // strings ending within the key are prefixes of the longer ones, they go first ordered by length
+        size_t ended = lt;
+        for (size_t len=depth; len<=depth+8; ++len){
+            for (size_t k=ended; k<gt; ++k){
+                if (items[k].s.len == len) str__sort_swap(&items[k], &items[ended++]);
+            }
+        }
+        // recurse into the two smaller parts and continue with the largest one, which bounds the recursion
+        // depth by log2(n) even when all strings share a long prefix and only the equal part is left
+        size_t equal = gt-ended;
+        if (equal >= lt && equal >= n-gt){
+            str__sort_keyed(items, lt, depth, budget);
+            str__sort_keyed(items+gt, n-gt, depth, budget);
+            items += ended;
+            n = equal;
+            depth += 8;
+            budget = str__sort_budget(n);
+            for (size_t k=0; k<n; ++k){
+                items[k].key = str__sort_key(items[k].s, depth);
+            }
+        }
+        else{
+            str__sort_depth(items+ended, equal, depth+8);
+            if (lt < n-gt){
+                str__sort_keyed(items, lt, depth, budget);
+                items += gt;
+                n -= gt;
+            }
+            else{
+                str__sort_keyed(items+gt, n-gt, depth, budget);
+                n = lt;
+            }
+        }
+    }
+}
+
+void str__sort_depth(str__sort_item *items, size_t n, size_t depth)
+{
+    if (n < 2) return;
+    for (size_t i=0; i<n; ++i){
+        items[i].key = str__sort_key(items[i].s, depth);
+    }
+    str__sort_keyed(items, n, depth, str__sort_budget(n));
+}
+
+str_array* str_array_sort(str_array *array, Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    if (array == NULL) return NULL;
+    if (array->count < 2) return array;
+    str__sort_item *items = str__alloc(alloc, array->count*sizeof(str__sort_item));
+    for (size_t i=0; i<array->count; ++i){
+        items[i].s = array->items[i];
+    }
+    str__sort_depth(items, array->count, 0);
+    for (size_t i=0; i<array->count; ++i){
+        array->items[i] = items[i].s;
+    }
+    dealloc(items);
+    return array;
+}
+
+str_array* str_array_dedup(str_array *array, Deallocator dealloc)
+{
+    if (array == NULL) return NULL;
+    if (array->count < 2) return array;
+    size_t w = 1;
+    for (size_t i=1; i<array->count; ++i){
+        if (str_equals(array->items[i], array->items[w-1])){
+            if (dealloc != NULL) str__free(array->items[i], dealloc);
+        }
+        else{
+            array->items[w++] = array->items[i];
+        }
+    }
+    array->count = w;
+    return array;
+}
+
+// alloc and dealloc are used for the scratch array, item_dealloc frees the duplicates and may be NULL for views
+str_array* str_array_sort_unique(str_array *array, Allocator alloc, Deallocator dealloc, Deallocator item_dealloc)
+{
+    return str_array_dedup(str_array_sort(array, alloc, dealloc), item_dealloc);
+}
+
+// whether the items are in the bytewise order str_array_sort would produce, duplicates allowed
+bool str__sorted(str_array array)
+{
+    for (size_t i=1; i<array.count; ++i){
+        str a = array.items[i-1], b = array.items[i];
+        size_t length = a.len < b.len ? a.len : b.len;
+        size_t k = 0;
+        while (k < length && a.value[k] == b.value[k]) k++;
+        if (k < length ? (unsigned char) a.value[k] > (unsigned char) b.value[k] : a.len > b.len) return false;
+    }
+    return true;
+}
+
+str_prefix_index str_prefix_index_new(str_array array, Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    if (array.count == 0) return (str_prefix_index) {0};
+    str_array sorted = {.items=str__alloc(alloc, array.count*sizeof(str)), .count=array.count};
+    strlib_ncpy((char*) array.items, array.count*sizeof(str), (char*) sorted.items);
+    // vocabularies are usually stored in order already, one linear pass then saves the sort
+    if (!str__sorted(sorted)) str_array_sort(&sorted, alloc, dealloc);
+    str_array_dedup(&sorted, NULL);
+    size_t *parent = str__alloc(alloc, sorted.count*sizeof(size_t));
+    for (size_t i=0; i<sorted.count; ++i){
+        // the prefixes of items[i] are on the prefix chain of items[i-1]
+        size_t p = i > 0 ? i-1 : SIZE_MAX;
+        while (p != SIZE_MAX && !str_starts_with_str(sorted.items[i], sorted.items[p])) p = parent[p];
+        parent[i] = p;
+    }
+    return (str_prefix_index) {.items=sorted.items, .parent=parent, .count=sorted.count};
+}
+
+// binary search for the first item not below query; with past_prefix, items starting with query count as below.
+// Tracks the common prefix with both bounds so bytes shared by the whole range are never compared twice.
+size_t str__prefix_bound(str_prefix_index index, str query, bool past_prefix)
+{
+    size_t lo = 0, hi = index.count;
+    size_t lcp_lo = 0, lcp_hi = 0;
+    while (lo < hi){
+        size_t mid = lo + (hi-lo)/2;
+        str item = index.items[mid];
+        size_t l = lcp_lo < lcp_hi ? lcp_lo : lcp_hi;
+        while (l < item.len && l < query.len && item.value[l] == query.value[l]) l++;
+        bool below;
+        if (l == query.len) below = past_prefix;
+        else if (l == item.len) below = true;
+        else below = (unsigned char) item.value[l] < (unsigned char) query.value[l];
+        if (below){
+            lo = mid+1;
+            lcp_lo = l;
+        }
+        else{
+            hi = mid;
+            lcp_hi = l;
+        }
+    }
+    return lo;
+}
+
+str_array str_prefix_index_find(str_prefix_index index, str prefix)
+{
+    size_t from = str__prefix_bound(index, prefix, false);
+    size_t to = str__prefix_bound(index, prefix, true);
+    if (from >= to) return (str_array) {0};
+    return (str_array) {.items=index.items+from, .count=to-from};
+}
+
+size_t str_prefix_index_count(str_prefix_index index, str prefix)
+{
+    return str_prefix_index_find(index, prefix).count;
+}
+
+int str_prefix_index_longest(str_prefix_index index, str query)
+{
+    size_t i = str__prefix_bound(index, query, false);
+    if (i < index.count && str_equals(index.items[i], query)) return i;
+    if (i == 0) return STR_NOT_FOUND;
+    // every item that is a prefix of query is on the prefix chain of the last item below query
+    size_t p = i-1;
+    str item = index.items[p];
+    size_t l = 0;
+    while (l < item.len && l < query.len && item.value[l] == query.value[l]) l++;
+    while (p != SIZE_MAX && index.items[p].len > l) p = index.parent[p];
+    return p == SIZE_MAX ? STR_NOT_FOUND : (int) p;
+}
+
+#define STR__PACK_MAGIC "STRPACK1"
+#define STR__PACK_HEADER 3
+
+str_pack str_pack_new(Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    return (str_pack) {.alloc=alloc, .dealloc=dealloc};
+}
+
+str_pack str_pack_from_array(str_array array, Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    size_t size = 0;
+    for (size_t i=0; i<array.count; ++i){
+        size += array.items[i].len+1;
+    }
+    str_pack pack = {
+        .data=str__alloc(alloc, size > 0 ? size : 1),
+        .offsets=str__alloc(alloc, (array.count+1)*sizeof(uint64_t)),
+        .count=array.count,
+        .size=size,
+        .data_cap=size,
+        .count_cap=array.count,
+        .alloc=alloc,
+        .dealloc=dealloc
+    };
+    char *w = pack.data;
+    for (size_t i=0; i<array.count; ++i){
+        pack.offsets[i] = w-pack.data;
+        w = strlib_ncpy(array.items[i].value, array.items[i].len, w);
+        *w++ = '\0';
+    }
+    pack.offsets[array.count] = size;
+    return pack;
+}
+
+str_array str_pack_to_array(str_pack pack, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    if (pack.count == 0) return (str_array) {0};
+    str *items = str__alloc(alloc, pack.count*sizeof(str));
+    for (size_t i=0; i<pack.count; ++i){
+        items[i] = str__copy(str_pack_at(pack, i), alloc);
+    }
+    return (str_array) {.items=items, .count=pack.count};
+}
+
+str_pack* str_pack_push(str_pack *pack, str s)
+{
+    if (pack == NULL) return NULL;
+    if (pack->dealloc == NULL){
+        str_error("cannot push to a pack opened from a serialized buffer!");
+        return pack;
+    }
+    if (pack->offsets == NULL || pack->count == pack->count_cap){
+        size_t cap = pack->count_cap < 8 ? 16 : 2*pack->count_cap;
+        size_t used = pack->offsets == NULL ? 0 : pack->count+1;
+        pack->offsets = str__realloc(pack->alloc, pack->dealloc, pack->offsets, used*sizeof(uint64_t), (cap+1)*sizeof(uint64_t));
+        pack->count_cap = cap;
+    }
+    if (pack->size + s.len+1 > pack->data_cap){
+        size_t cap = 2*pack->data_cap;
+        if (cap < pack->size + s.len+1) cap = pack->size + s.len+1;
+        if (cap < 64) cap = 64;
+        pack->data = str__realloc(pack->alloc, pack->dealloc, pack->data, pack->size, cap);
+        pack->data_cap = cap;
+    }
+    char *w = strlib_ncpy(s.value, s.len, pack->data+pack->size);
+    *w = '\0';
+    pack->offsets[pack->count] = pack->size;
+    pack->size += s.len+1;
+    pack->offsets[++pack->count] = pack->size;
+    return pack;
+}
+
+str str_pack_at(str_pack pack, size_t index)
+{
+    if (index >= pack.count) return (str) {0};
+    uint64_t from = pack.offsets[index];
+    uint64_t to = pack.offsets[index+1];
+    // offsets of an opened pack come from the file, so every view is checked to be in bounds and terminated
+    if (from >= to || to > pack.size || pack.data[to-1] != '\0') return (str) {0};
+    return (str) {.value=pack.data+from, .len=to-from-1};
+}
+
+bool str_pack_write(str_pack pack, FILE *file)
+{
+    if (file == NULL) return false;
+    uint64_t header[STR__PACK_HEADER] = {0, pack.count, pack.size};
+    strlib_ncpy(STR__PACK_MAGIC, sizeof(uint64_t), (char*) header);
+    uint64_t empty = 0;
+    uint64_t *offsets = pack.count > 0 ? pack.offsets : &empty;
+    if (fwrite(header, sizeof(uint64_t), STR__PACK_HEADER, file) != STR__PACK_HEADER
+        || fwrite(offsets, sizeof(uint64_t), pack.count+1, file) != pack.count+1
+        || (pack.size > 0 && fwrite(pack.data, 1, pack.size, file) != pack.size)){
+        str_error("failed to write pack!");
+        return false;
+    }
+    return true;
+}
+
+str_pack str_pack_open(void *data, size_t size)
+{
+    uint64_t *header = data;
+    if (data == NULL || size < (STR__PACK_HEADER+1)*sizeof(uint64_t) || !str_starts_with_str((str) {.value=data, .len=sizeof(uint64_t)}, str(STR__PACK_MAGIC))){
+        str_error("not a serialized pack!");
+        return (str_pack) {0};
+    }
+    if ((uintptr_t) data % sizeof(uint64_t) != 0){
+        str_error("serialized pack has to be 8-byte aligned!");
+        return (str_pack) {0};
+    }
+    uint64_t count = header[1];
+    uint64_t bytes = header[2];
+    uint64_t *offsets = header + STR__PACK_HEADER;
+    // bound count first, so that neither the table size nor the remaining space can wrap around
+    size_t words = size/sizeof(uint64_t);
+    if (count > words-STR__PACK_HEADER-1 || bytes > size-(STR__PACK_HEADER+count+1)*sizeof(uint64_t) || offsets[0] != 0 || offsets[count] != bytes){
+        str_error("serialized pack is truncated or corrupted!");
+        return (str_pack) {0};
+    }
+    return (str_pack) {
+        .data=(char*) (offsets+count+1),
+        .offsets=offsets,
+        .count=count,
+        .size=bytes,
+        .data_cap=bytes,
+        .count_cap=count
+    };
+}
+
+str str__copy(str view, Allocator alloc)
+{
+    if (view.len == 0) return str_new("", alloc);
+    char *value = str__alloc(alloc, view.len+1);
+    strlib_ncpy(view.value, view.len, value);
+    return (str) {.value=value, .len=view.len};
+}
+
 str str_trim_left(str string, char c, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (string.len == 0) return str_new("", alloc);
-    char *r = string.value;
-    while (*r == c){r++;}
-    size_t length = string.value + string.len - r;
-    if (length == 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(r, length, value);
-    return (str) {.value=value, .len=length};
+    return str__copy(str_trim_left_set(string, str_charset_new((str) {.value=&c, .len=1})), alloc);
 }
 
 str str_trim_left_str(str string, str s, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (s.len > string.len) return str_new("", alloc);
-    char *r = string.value;
-    while (str_starts_with_str(str(r), s)) r += s.len;
-    size_t length = string.value + string.len - r;
-    if (length == 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(r, length, value);
-    return (str) {.value=value, .len=length};
+    while (s.len > 0 && str_starts_with_str(string, s)) string = str_from(string, s.len);
+    return str__copy(string, alloc);
 }
 
 str str_trim_right(str string, char c, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (string.len == 0) return str_new("", alloc);
-    char *r = string.value + string.len - 1;
-    while (*r == c && r>=string.value) {r--;}
-    size_t length = r-string.value+1;
-    if (length == 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(string.value, length, value);
-    return (str) {.value=value, .len=length};
+    return str__copy(str_trim_right_set(string, str_charset_new((str) {.value=&c, .len=1})), alloc);
 }
 
 str str_trim_right_str(str string, str s, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (s.len > string.len) return str_new("", alloc);
-    char *r = string.value + string.len - s.len;
-    while (r >= string.value && str_starts_with_str(str(r), s)) {r -= s.len;}
-    size_t length = r-string.value+2;
-    if (length == 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(string.value, length, value);
-    return (str) {.value=value, .len=length};
+    while (s.len > 0 && str_ends_with_str(string, s)) string.len -= s.len;
+    return str__copy(string, alloc);
 }
 
 str str_trim(str string, char c, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (string.len == 0) return str_new("", alloc);
-    char *r1 = string.value;
-    char *r2 = r1 + string.len - 1;
-    while (r1 <= r2 && (*r1 == c || *r2 == c)) {
-        if (*r1 == c) r1++;
-        if (*r2 == c) r2--;
-    }
-    int length = r2-r1+1;
-    if (length <= 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(r1, length, value);
-    return (str) {.value=value, .len=length};
+    return str__copy(str_trim_set(string, str_charset_new((str) {.value=&c, .len=1})), alloc);
 }
 
 str str_trim_str(str string, str s, Allocator alloc)
 {
     str__assert_allocator(alloc);
     if (string.value == NULL) return (str) {0};
-    if (string.len == 0 || s.len > string.len) return str_new("", alloc);
-    char *r1 = string.value;
-    char *r2 = string.value + string.len - s.len;
-    bool f1 = false;
-    bool f2 = false;
-    while (r1 <= r2 && ((f1 = str_starts_with_str(str(r1), s)) || (f2 = str_starts_with_str(str(r2), s)))){
-        if (f1) r1 += s.len;
-        if (f2) r2 -= s.len;
-    }
-    int length = r2-r1+2;
-    if (length <= 0) return str_new("", alloc);
-    char *value = str__alloc(alloc, length+1);
-    strlib_ncpy(r1, length, value);
-    return (str) {.value=value, .len=length};
+    while (s.len > 0 && str_starts_with_str(string, s)) string = str_from(string, s.len);
+    while (s.len > 0 && str_ends_with_str(string, s)) string.len -= s.len;
+    return str__copy(string, alloc);
 }
 
 str str_join(str_array strings, char delimiter, Allocator alloc)
@@ -796,6 +1475,826 @@ str str_join_str(str_array strings, str delimiter, Allocator alloc)
     return (str) {.value=value, .len=length};
 }
 
+str_charset str_charset_new(str chars)
+{
+    str_charset set = {0};
+    for (size_t i=0; i<chars.len; ++i){
+        unsigned char c = chars.value[i];
+        set.bits[(c&15) + ((c>>7)<<4)] |= 1 << ((c>>4)&7);
+    }
+    return set;
+}
+
+bool str_charset_has(str_charset set, char c)
+{
+    unsigned char u = c;
+    return (set.bits[(u&15) + ((u>>7)<<4)] >> ((u>>4)&7)) & 1;
+}
+
+// returns the index of the first byte whose membership in set differs from member
+size_t str__charset_scan(str string, const str_charset *set, bool member)
+{
+    size_t i = 0;
+    if (string.value == NULL) return 0;
+#ifdef __SSSE3__
+    const __m128i t0 = _mm_loadu_si128((const __m128i*) set->bits);
+    const __m128i t1 = _mm_loadu_si128((const __m128i*) (set->bits+16));
+    const __m128i bitmask = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i seven = _mm_set1_epi8(7);
+    for (; i+16 <= string.len; i+=16){
+        __m128i v = _mm_loadu_si128((const __m128i*) (string.value+i));
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i upper = _mm_cmpgt_epi8(hi, seven);
+        __m128i row = _mm_or_si128(_mm_andnot_si128(upper, _mm_shuffle_epi8(t0, lo)), _mm_and_si128(upper, _mm_shuffle_epi8(t1, lo)));
+        __m128i bit = _mm_shuffle_epi8(bitmask, hi);
+        int outside = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), _mm_setzero_si128()));
+        int stop = member ? outside : (~outside & 0xffff);
+        if (stop != 0) return i + __builtin_ctz(stop);
+    }
+#endif // __SSSE3__
+    for (; i<string.len; ++i){
+        if (str_charset_has(*set, string.value[i]) != member) return i;
+    }
+    return string.len;
+}
+
+size_t str_span(str string, str_charset set)
+{
+    return str__charset_scan(string, &set, true);
+}
+
+size_t str_cspan(str string, str_charset set)
+{
+    return str__charset_scan(string, &set, false);
+}
+
+int str_find_first_of(str string, str chars)
+{
+    size_t i = str_cspan(string, str_charset_new(chars));
+    return i < string.len ? (int) i : STR_NOT_FOUND;
+}
+
+int str_find_first_not_of(str string, str chars)
+{
+    size_t i = str_span(string, str_charset_new(chars));
+    return i < string.len ? (int) i : STR_NOT_FOUND;
+}
+
+str str_trim_left_set(str string, str_charset set)
+{
+    if (string.value == NULL) return (str) {0};
+    size_t i = str__charset_scan(string, &set, true);
+    return (str) {.value=string.value+i, .len=string.len-i};
+}
+
+str str_trim_right_set(str string, str_charset set)
+{
+    if (string.value == NULL) return (str) {0};
+    size_t length = string.len;
+    while (length > 0 && str_charset_has(set, string.value[length-1])) length--;
+    return (str) {.value=string.value, .len=length};
+}
+
+str str_trim_set(str string, str_charset set)
+{
+    return str_trim_right_set(str_trim_left_set(string, set), set);
+}
+
+str str_strip_chars(str string, str chars)
+{
+    return str_trim_set(string, str_charset_new(chars));
+}
+
+str str_next_token(str *rest, str_charset delimiters)
+{
+    if (rest == NULL || rest->value == NULL) return (str) {0};
+    size_t from = str__charset_scan(*rest, &delimiters, true);
+    if (from == rest->len){
+        *rest = (str) {.value=rest->value+rest->len, .len=0};
+        return (str) {0};
+    }
+    str remaining = {.value=rest->value+from, .len=rest->len-from};
+    size_t length = str__charset_scan(remaining, &delimiters, false);
+    *rest = (str) {.value=remaining.value+length, .len=remaining.len-length};
+    return (str) {.value=remaining.value, .len=length};
+}
+
+// hex and base64 codecs. Encoders never fail; decoders return a str with a NULL value on invalid input.
+// Hex is encoded in lowercase and decoded in either case. Base64 uses the standard alphabet with padding,
+// or with url set the URL-safe alphabet without padding, in which case decoding also accepts padded input.
+
+#define STR__HEX_DIGITS "0123456789abcdef"
+#define STR__BASE64 "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+#define STR__BASE64_URL "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+
+int str__hex_value(unsigned char c)
+{
+    if (c >= '0' && c <= '9') return c-'0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c-'a'+10;
+    return -1;
+}
+
+int str__base64_value(unsigned char c, bool url)
+{
+    if (c >= 'A' && c <= 'Z') return c-'A';
+    if (c >= 'a' && c <= 'z') return c-'a'+26;
+    if (c >= '0' && c <= '9') return c-'0'+52;
+    if (c == (url ? '-' : '+')) return 62;
+    if (c == (url ? '_' : '/')) return 63;
+    return -1;
+}
+
+#ifdef __AVX2__
+// the AVX2 kernels process whole blocks and return how much input they consumed, the scalar code finishes the rest
+
+size_t str__hex_encode_avx2(const unsigned char *src, size_t n, char *dst)
+{
+    const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i+32 <= n; i+=32){
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src+i));
+        __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, nibble));
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*) (dst+2*i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*) (dst+2*i+32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+__m256i str__hex_nibbles_avx2(__m256i c, __m256i *valid)
+{
+    __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+    *valid = _mm256_and_si256(*valid, _mm256_or_si256(is_digit, is_alpha));
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit), _mm256_and_si256(is_alpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+}
+
+size_t str__hex_decode_avx2(const char *src, size_t n, unsigned char *dst)
+{
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i+64 <= n; i+=64){
+        __m256i valid = _mm256_set1_epi8(-1);
+        __m256i a = str__hex_nibbles_avx2(_mm256_loadu_si256((const __m256i*) (src+i)), &valid);
+        __m256i b = str__hex_nibbles_avx2(_mm256_loadu_si256((const __m256i*) (src+i+32)), &valid);
+        if (_mm256_movemask_epi8(valid) != -1) break;
+        __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+        _mm256_storeu_si256((__m256i*) (dst+i/2), _mm256_permute4x64_epi64(bytes, 0xD8));
+    }
+    return i;
+}
+
+size_t str__base64_encode_avx2(const unsigned char *src, size_t n, char *dst, bool url)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    // offsets from the 6-bit index to its character, selected by a reduced index (Mula's pshufb lookup)
+    const __m256i offsets = url
+        ? _mm256_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 65, 0, 0,
+                           71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 65, 0, 0)
+        : _mm256_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0,
+                           71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0);
+    size_t i = 0;
+    for (; i+28 <= n; i+=24){
+        __m128i lo = _mm_loadu_si128((const __m128i*) (src+i));
+        __m128i hi = _mm_loadu_si128((const __m128i*) (src+i+12));
+        __m256i v = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i index = _mm256_or_si256(t0, t1);
+        __m256i reduced = _mm256_subs_epu8(index, _mm256_set1_epi8(51));
+        __m256i lower = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), index);
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(lower, _mm256_set1_epi8(13)));
+        __m256i out = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, reduced), index);
+        _mm256_storeu_si256((__m256i*) (dst+i/3*4), out);
+    }
+    return i;
+}
+
+size_t str__base64_decode_avx2(const char *src, size_t n, unsigned char *dst, bool url)
+{
+    // a byte c is valid when lo[c&15] & hi[c>>4] == 0, its value is c + roll[c>>4] except for the special character
+    const __m256i lut_lo = url
+        ? _mm256_setr_epi8(49, 33, 33, 33, 33, 33, 33, 33, 33, 33, 35, 47, 47, 15, 47, 39,
+                           49, 33, 33, 33, 33, 33, 33, 33, 33, 33, 35, 47, 47, 15, 47, 39)
+        : _mm256_setr_epi8(25, 17, 17, 17, 17, 17, 17, 17, 17, 17, 19, 7, 23, 23, 23, 7,
+                           25, 17, 17, 17, 17, 17, 17, 17, 17, 17, 19, 7, 23, 23, 23, 7);
+    const __m256i lut_hi = url
+        ? _mm256_setr_epi8(1, 1, 32, 2, 16, 8, 16, 4, 1, 1, 1, 1, 1, 1, 1, 1,
+                           1, 1, 32, 2, 16, 8, 16, 4, 1, 1, 1, 1, 1, 1, 1, 1)
+        : _mm256_setr_epi8(1, 1, 16, 2, 8, 4, 8, 4, 1, 1, 1, 1, 1, 1, 1, 1,
+                           1, 1, 16, 2, 8, 4, 8, 4, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 0, url ? 17 : 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 0, url ? 17 : 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i special = _mm256_set1_epi8(url ? '_' : '/');
+    const __m256i special_roll = _mm256_set1_epi8(url ? -32 : 16);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i store = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+    size_t i = 0;
+    for (; i+32 <= n; i+=32){
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src+i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble);
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi));
+        if (!_mm256_testz_si256(invalid, invalid)) break;
+        __m256i roll = _mm256_blendv_epi8(_mm256_shuffle_epi8(lut_roll, hi), special_roll, _mm256_cmpeq_epi8(v, special));
+        v = _mm256_add_epi8(v, roll);
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0));
+        _mm256_maskstore_epi32((int*) (dst+i/4*3), store, v);
+    }
+    return i;
+}
+#endif // __AVX2__
+
+void str__hex_encode(const unsigned char *src, size_t n, char *dst)
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    i = str__hex_encode_avx2(src, n, dst);
+#endif // __AVX2__
+    for (; i<n; ++i){
+        dst[2*i] = STR__HEX_DIGITS[src[i] >> 4];
+        dst[2*i+1] = STR__HEX_DIGITS[src[i] & 15];
+    }
+}
+
+bool str__hex_decode(const char *src, size_t n, unsigned char *dst)
+{
+    if (n % 2 != 0) return false;
+    size_t i = 0;
+#ifdef __AVX2__
+    i = str__hex_decode_avx2(src, n, dst);
+#endif // __AVX2__
+    for (; i<n; i+=2){
+        int hi = str__hex_value(src[i]);
+        int lo = str__hex_value(src[i+1]);
+        if (hi < 0 || lo < 0) return false;
+        dst[i/2] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+size_t str__base64_encoded_len(size_t n, bool url)
+{
+    if (url) return n/3*4 + (n%3 != 0 ? n%3+1 : 0);
+    return (n+2)/3*4;
+}
+
+size_t str__base64_encode(const unsigned char *src, size_t n, char *dst, bool url)
+{
+    const char *alphabet = url ? STR__BASE64_URL : STR__BASE64;
+    size_t i = 0;
+#ifdef __AVX2__
+    i = str__base64_encode_avx2(src, n, dst, url);
+#endif // __AVX2__
+    char *w = dst + i/3*4;
+    for (; i+3 <= n; i+=3){
+        uint32_t v = (uint32_t) src[i] << 16 | (uint32_t) src[i+1] << 8 | src[i+2];
+        *w++ = alphabet[v >> 18];
+        *w++ = alphabet[(v >> 12) & 63];
+        *w++ = alphabet[(v >> 6) & 63];
+        *w++ = alphabet[v & 63];
+    }
+    if (i < n){
+        uint32_t v = (uint32_t) src[i] << 16 | (i+1 < n ? (uint32_t) src[i+1] << 8 : 0);
+        *w++ = alphabet[v >> 18];
+        *w++ = alphabet[(v >> 12) & 63];
+        if (i+1 < n) *w++ = alphabet[(v >> 6) & 63];
+        else if (!url) *w++ = '=';
+        if (!url) *w++ = '=';
+    }
+    return w-dst;
+}
+
+// checks length, padding and the unused bits of the last character, and returns the number of characters to decode
+bool str__base64_layout(str base64, bool url, size_t *body, size_t *out_len)
+{
+    size_t n = base64.len;
+    size_t pad = 0;
+    while (pad < 2 && n > 0 && base64.value[n-1] == '='){
+        n--;
+        pad++;
+    }
+    if ((pad > 0 || !url) && (n+pad) % 4 != 0) return false;
+    if (n % 4 == 1) return false;
+    if (n % 4 != 0){
+        int last = str__base64_value(base64.value[n-1], url);
+        if (last < 0 || (last & (n%4 == 2 ? 0x0f : 0x03)) != 0) return false;
+    }
+    *body = n;
+    *out_len = n/4*3 + (n%4 != 0 ? n%4-1 : 0);
+    return true;
+}
+
+bool str__base64_decode(const char *src, size_t n, unsigned char *dst, bool url)
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    i = str__base64_decode_avx2(src, n - n%4, dst, url);
+#endif // __AVX2__
+    unsigned char *w = dst + i/4*3;
+    for (; i<n; i+=4){
+        size_t m = n-i < 4 ? n-i : 4;
+        uint32_t v = 0;
+        for (size_t k=0; k<4; ++k){
+            int d = k < m ? str__base64_value(src[i+k], url) : 0;
+            if (d < 0) return false;
+            v = (v << 6) | d;
+        }
+        *w++ = v >> 16;
+        if (m > 2) *w++ = (v >> 8) & 0xff;
+        if (m > 3) *w++ = v & 0xff;
+    }
+    return true;
+}
+
+str str_hex_encode(str data, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    char *value = str__alloc(alloc, 2*data.len+1);
+    str__hex_encode((const unsigned char*) data.value, data.len, value);
+    return (str) {.value=value, .len=2*data.len};
+}
+
+str str_hex_decode(str hex, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    if (hex.len % 2 != 0 || str_span(hex, str_charset_new(str("0123456789abcdefABCDEF"))) != hex.len) return (str) {0};
+    char *value = str__alloc(alloc, hex.len/2+1);
+    str__hex_decode(hex.value, hex.len, (unsigned char*) value);
+    return (str) {.value=value, .len=hex.len/2};
+}
+
+str str_base64_encode(str data, bool url, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    size_t length = str__base64_encoded_len(data.len, url);
+    char *value = str__alloc(alloc, length+1);
+    str__base64_encode((const unsigned char*) data.value, data.len, value, url);
+    return (str) {.value=value, .len=length};
+}
+
+str str_base64_decode(str base64, bool url, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    size_t body, length;
+    if (!str__base64_layout(base64, url, &body, &length)) return (str) {0};
+    str chars = {.value=base64.value, .len=body};
+    if (str_span(chars, str_charset_new(str(url ? STR__BASE64_URL : STR__BASE64))) != body) return (str) {0};
+    char *value = str__alloc(alloc, length+1);
+    str__base64_decode(base64.value, body, (unsigned char*) value, url);
+    return (str) {.value=value, .len=length};
+}
+
+str str_hex_encode_to_buffer(str data, char *buffer, size_t buffer_size)
+{
+    if (buffer == NULL || 2*data.len >= buffer_size) return (str) {0};
+    str__hex_encode((const unsigned char*) data.value, data.len, buffer);
+    buffer[2*data.len] = '\0';
+    return (str) {.value=buffer, .len=2*data.len};
+}
+
+str str_hex_decode_to_buffer(str hex, char *buffer, size_t buffer_size)
+{
+    if (buffer == NULL || hex.len/2 >= buffer_size) return (str) {0};
+    if (!str__hex_decode(hex.value, hex.len, (unsigned char*) buffer)) return (str) {0};
+    buffer[hex.len/2] = '\0';
+    return (str) {.value=buffer, .len=hex.len/2};
+}
+
+str str_base64_encode_to_buffer(str data, bool url, char *buffer, size_t buffer_size)
+{
+    size_t length = str__base64_encoded_len(data.len, url);
+    if (buffer == NULL || length >= buffer_size) return (str) {0};
+    str__base64_encode((const unsigned char*) data.value, data.len, buffer, url);
+    buffer[length] = '\0';
+    return (str) {.value=buffer, .len=length};
+}
+
+str str_base64_decode_to_buffer(str base64, bool url, char *buffer, size_t buffer_size)
+{
+    size_t body, length;
+    if (buffer == NULL || !str__base64_layout(base64, url, &body, &length) || length >= buffer_size) return (str) {0};
+    if (!str__base64_decode(base64.value, body, (unsigned char*) buffer, url)) return (str) {0};
+    buffer[length] = '\0';
+    return (str) {.value=buffer, .len=length};
+}
+
+int str__glob_token(str pattern, size_t *i, uint64_t set[4])
+{
+    set[0] = set[1] = set[2] = set[3] = 0;
+    if (*i >= pattern.len) return 0;
+    unsigned char c = pattern.value[(*i)++];
+    if (c == '*'){
+        while (*i < pattern.len && pattern.value[*i] == '*') (*i)++;
+        return 2;
+    }
+    if (c == '?'){
+        set[0] = set[1] = set[2] = set[3] = ~(uint64_t)0;
+        return 1;
+    }
+    if (c == '\\' && *i < pattern.len){
+        c = pattern.value[(*i)++];
+    }
+    else if (c == '['){
+        size_t j = *i;
+        bool negate = false;
+        if (j < pattern.len && (pattern.value[j] == '!' || pattern.value[j] == '^')){
+            negate = true;
+            j++;
+        }
+        size_t first = j;
+        while (j < pattern.len && (pattern.value[j] != ']' || j == first)){
+            unsigned char lo = pattern.value[j++];
+            if (lo == '\\' && j < pattern.len) lo = pattern.value[j++];
+            unsigned char hi = lo;
+            if (j+1 < pattern.len && pattern.value[j] == '-' && pattern.value[j+1] != ']'){
+                hi = pattern.value[j+1];
+                j += 2;
+                if (hi == '\\' && j < pattern.len) hi = pattern.value[j++];
+            }
+            for (unsigned v=lo; v<=hi; ++v){
+                set[v>>6] |= (uint64_t)1 << (v&63);
+            }
+        }
+        if (j < pattern.len){
+            *i = j+1;
+            if (negate){
+                for (size_t k=0; k<4; ++k) set[k] = ~set[k];
+            }
+            return 1;
+        }
+        // unterminated class, the '[' is matched literally
+        set[0] = set[1] = set[2] = set[3] = 0;
+    }
+    set[c>>6] |= (uint64_t)1 << (c&63);
+    return 1;
+}
+
+#define STR__STAGE_MAP 0
+#define STR__STAGE_REPLACE 1
+#define STR__STAGE_TRIM 2
+
+str_pipeline str_pipeline_new(Allocator alloc, Deallocator dealloc)
+{
+    str__assert_allocator(alloc);
+    str__assert_deallocator(dealloc);
+    return (str_pipeline) {.alloc=alloc, .dealloc=dealloc};
+}
+
+str_pipeline_stage* str__pipeline_add(str_pipeline *pipeline, int kind)
+{
+    if (pipeline->count == pipeline->cap){
+        size_t cap = pipeline->cap < 4 ? 8 : 2*pipeline->cap;
+        pipeline->stages = str__realloc(pipeline->alloc, pipeline->dealloc, pipeline->stages,
+                                        pipeline->count*sizeof(str_pipeline_stage), cap*sizeof(str_pipeline_stage));
+        pipeline->cap = cap;
+    }
+    str_pipeline_stage *stage = &pipeline->stages[pipeline->count++];
+    stage->kind = kind;
+    return stage;
+}
+
+// consecutive per-byte transformations are composed into one lookup table
+int16_t* str__pipeline_map(str_pipeline *pipeline)
+{
+    if (pipeline->count > 0 && pipeline->stages[pipeline->count-1].kind == STR__STAGE_MAP){
+        return pipeline->stages[pipeline->count-1].map;
+    }
+    str_pipeline_stage *stage = str__pipeline_add(pipeline, STR__STAGE_MAP);
+    for (int c=0; c<256; ++c) stage->map[c] = c;
+    return stage->map;
+}
+
+str_pipeline* str_pipeline_to_upper(str_pipeline *pipeline)
+{
+    if (pipeline == NULL) return NULL;
+    int16_t *map = str__pipeline_map(pipeline);
+    for (int c=0; c<256; ++c){
+        if (map[c] > 0x60 && map[c] < 0x7b) map[c] &= 0xDF;
+    }
+    return pipeline;
+}
+
+str_pipeline* str_pipeline_to_lower(str_pipeline *pipeline)
+{
+    if (pipeline == NULL) return NULL;
+    int16_t *map = str__pipeline_map(pipeline);
+    for (int c=0; c<256; ++c){
+        if (map[c] > 0x40 && map[c] < 0x5b) map[c] |= 0x20;
+    }
+    return pipeline;
+}
+
+str_pipeline* str_pipeline_replace(str_pipeline *pipeline, char a, char b)
+{
+    if (pipeline == NULL) return NULL;
+    int16_t *map = str__pipeline_map(pipeline);
+    for (int c=0; c<256; ++c){
+        if (map[c] == (unsigned char) a) map[c] = (unsigned char) b;
+    }
+    return pipeline;
+}
+
+str_pipeline* str_pipeline_remove(str_pipeline *pipeline, char c)
+{
+    if (pipeline == NULL) return NULL;
+    int16_t *map = str__pipeline_map(pipeline);
+    for (int i=0; i<256; ++i){
+        if (map[i] == (unsigned char) c) map[i] = -1;
+    }
+    return pipeline;
+}
+
+str_pipeline* str_pipeline_replace_str(str_pipeline *pipeline, str a, str b)
+{
+    if (pipeline == NULL) return NULL;
+    if (a.len == 0) return pipeline;
+    str_pipeline_stage *stage = str__pipeline_add(pipeline, STR__STAGE_REPLACE);
+    stage->a = str__copy(a, pipeline->alloc);
+    stage->b = str__copy(b, pipeline->alloc);
+    stage->fail = str__alloc(pipeline->alloc, a.len*sizeof(size_t));
+    for (size_t i=1, k=0; i<a.len; ++i){
+        while (k > 0 && a.value[i] != a.value[k]) k = stage->fail[k-1];
+        if (a.value[i] == a.value[k]) k++;
+        stage->fail[i] = k;
+    }
+    return pipeline;
+}
+
+str_pipeline* str_pipeline_remove_str(str_pipeline *pipeline, str s)
+{
+    return str_pipeline_replace_str(pipeline, s, (str) {0});
+}
+
+str_pipeline* str_pipeline_trim(str_pipeline *pipeline, str_charset set)
+{
+    if (pipeline == NULL) return NULL;
+    str_pipeline_stage *stage = str__pipeline_add(pipeline, STR__STAGE_TRIM);
+    stage->set = set;
+    return pipeline;
+}
+
+void str__pipeline_push(str_pipeline *pipeline, size_t index, char c, char **w)
+{
+    if (index == pipeline->count){
+        *(*w)++ = c;
+        return;
+    }
+    str_pipeline_stage *stage = &pipeline->stages[index];
+    switch (stage->kind){
+        case STR__STAGE_MAP:{
+            int16_t v = stage->map[(unsigned char) c];
+            if (v >= 0) str__pipeline_push(pipeline, index+1, (char) v, w);
+        } break;
+        case STR__STAGE_REPLACE:{
+            // a mismatch falls back to the longest border, the bytes before it cannot start a match anymore
+            while (stage->matched > 0 && stage->a.value[stage->matched] != c){
+                size_t border = stage->fail[stage->matched-1];
+                for (size_t i=0; i<stage->matched-border; ++i){
+                    str__pipeline_push(pipeline, index+1, stage->a.value[i], w);
+                }
+                stage->matched = border;
+            }
+            if (stage->a.value[stage->matched] != c){
+                str__pipeline_push(pipeline, index+1, c, w);
+            }
+            else if (++stage->matched == stage->a.len){
+                for (size_t i=0; i<stage->b.len; ++i){
+                    str__pipeline_push(pipeline, index+1, stage->b.value[i], w);
+                }
+                stage->matched = 0;
+            }
+        } break;
+        case STR__STAGE_TRIM:{
+            if (str_charset_has(stage->set, c)){
+                if (!stage->started) break;
+                if (stage->held_len == stage->held_cap){
+                    size_t cap = stage->held_cap < 16 ? 32 : 2*stage->held_cap;
+                    stage->held = str__realloc(pipeline->alloc, pipeline->dealloc, stage->held, stage->held_len, cap);
+                    stage->held_cap = cap;
+                }
+                stage->held[stage->held_len++] = c;
+                break;
+            }
+            stage->started = true;
+            for (size_t i=0; i<stage->held_len; ++i){
+                str__pipeline_push(pipeline, index+1, stage->held[i], w);
+            }
+            stage->held_len = 0;
+            str__pipeline_push(pipeline, index+1, c, w);
+        } break;
+    }
+}
+
+// upper bound of the output length, a replace stage grows at most once per needle length of its input
+size_t str__pipeline_bound(str_pipeline *pipeline, size_t length)
+{
+    for (size_t i=0; i<pipeline->count; ++i){
+        str_pipeline_stage *stage = &pipeline->stages[i];
+        if (stage->kind == STR__STAGE_REPLACE && stage->b.len > stage->a.len){
+            length += length/stage->a.len * (stage->b.len-stage->a.len);
+        }
+    }
+    return length;
+}
+
+char* str__pipeline_apply(str_pipeline *pipeline, str string, char *w)
+{
+    for (size_t i=0; i<pipeline->count; ++i){
+        pipeline->stages[i].matched = 0;
+        pipeline->stages[i].started = false;
+        pipeline->stages[i].held_len = 0;
+    }
+    for (size_t i=0; i<string.len; ++i){
+        str__pipeline_push(pipeline, 0, string.value[i], &w);
+    }
+    // flush partial matches in order, later stages still see the flushed bytes
+    for (size_t i=0; i<pipeline->count; ++i){
+        str_pipeline_stage *stage = &pipeline->stages[i];
+        if (stage->kind != STR__STAGE_REPLACE) continue;
+        size_t matched = stage->matched;
+        stage->matched = 0;
+        for (size_t k=0; k<matched; ++k){
+            str__pipeline_push(pipeline, i+1, stage->a.value[k], &w);
+        }
+    }
+    return w;
+}
+
+str str_pipeline_run(str_pipeline *pipeline, str string, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    if (pipeline == NULL) return str_dup(string, alloc);
+    char *value = str__alloc(alloc, str__pipeline_bound(pipeline, string.len)+1);
+    char *w = str__pipeline_apply(pipeline, string, value);
+    *w = '\0';
+    return (str) {.value=value, .len=w-value};
+}
+
+str* str_pipeline_run_mod(str_pipeline *pipeline, str *string)
+{
+    if (string == NULL) return NULL;
+    if (pipeline == NULL || string->value == NULL) return string;
+    if (str__pipeline_bound(pipeline, string->len) > string->len){
+        str_error("cannot run a pipeline that may grow the string in place!");
+        return string;
+    }
+    // no stage emits more bytes than it has consumed, so the output never overtakes the input
+    char *w = str__pipeline_apply(pipeline, *string, string->value);
+    *w = '\0';
+    string->len = w-string->value;
+    return string;
+}
+
+str_array str_pipeline_run_array(str_pipeline *pipeline, str_array strings, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    if (strings.count == 0) return (str_array) {0};
+    str *items = str__alloc(alloc, strings.count*sizeof(str));
+    for (size_t i=0; i<strings.count; ++i){
+        items[i] = str_pipeline_run(pipeline, strings.items[i], alloc);
+    }
+    return (str_array) {.items=items, .count=strings.count};
+}
+
+str_glob str_glob_compile(str pattern, Allocator alloc)
+{
+    return str_glob_compile_set(str_array(pattern), alloc);
+}
+
+str_glob str_glob_compile_set(str_array patterns, Allocator alloc)
+{
+    str__assert_allocator(alloc);
+    if (patterns.count == 0) return (str_glob) {0};
+    uint64_t set[4];
+    size_t bits = 0;
+    for (size_t k=0; k<patterns.count; ++k){
+        size_t i = 0;
+        bits++;
+        while (str__glob_token(patterns.items[k], &i, set)) bits++;
+    }
+    size_t words = (bits+63)/64;
+    uint64_t *block = str__alloc(alloc, (2*256+2)*words*sizeof(uint64_t));
+    str_glob glob = {
+        .step=block,
+        .loop=block + 256*words,
+        .star=block + 512*words,
+        .start=block + 513*words,
+        .finals=str__alloc(alloc, patterns.count*sizeof(size_t)),
+        .words=words,
+        .count=patterns.count
+    };
+    size_t bit = 0;
+    for (size_t k=0; k<patterns.count; ++k){
+        size_t i = 0;
+        int kind;
+        glob.start[bit>>6] |= (uint64_t)1 << (bit&63);
+        while ((kind = str__glob_token(patterns.items[k], &i, set)) != 0){
+            uint64_t b = (uint64_t)1 << (bit&63);
+            size_t w = bit>>6;
+            if (kind == 2){
+                glob.star[w] |= b;
+                for (size_t c=0; c<256; ++c) glob.loop[c*words + w] |= b;
+            }
+            else{
+                for (size_t c=0; c<256; ++c){
+                    if (set[c>>6] & ((uint64_t)1 << (c&63))) glob.step[c*words + w] |= b;
+                }
+            }
+            bit++;
+        }
+        glob.finals[k] = bit++;
+    }
+    return glob;
+}
+
+void str__glob_close(const str_glob *glob, uint64_t *state)
+{
+    const uint64_t *star = glob->star;
+    for (size_t w=glob->words; w-- > 0;){
+        uint64_t carry = w > 0 ? (state[w-1] & star[w-1]) >> 63 : 0;
+        state[w] |= ((state[w] & star[w]) << 1) | carry;
+    }
+}
+
+// the state set lives in the caller's scratch or on the stack, so a compiled glob can be shared between threads
+uint64_t* str__glob_scratch(const str_glob *glob, uint64_t *scratch, uint64_t *stack)
+{
+    if (scratch != NULL) return scratch;
+    if (glob->words <= STR_GLOB_STACK_WORDS) return stack;
+    str_error("glob set with %zu states needs a scratch buffer of %zu words!", glob->words*64, glob->words);
+    return NULL;
+}
+
+bool str__glob_run(const str_glob *glob, str string, uint64_t *state)
+{
+    size_t words = glob->words;
+    for (size_t w=0; w<words; ++w){
+        state[w] = glob->start[w];
+    }
+    str__glob_close(glob, state);
+    for (size_t i=0; i<string.len; ++i){
+        unsigned char c = string.value[i];
+        const uint64_t *step = glob->step + c*words;
+        const uint64_t *loop = glob->loop + c*words;
+        uint64_t alive = 0;
+        for (size_t w=words; w-- > 0;){
+            uint64_t s = state[w];
+            uint64_t carry = w > 0 ? (state[w-1] & step[w-1]) >> 63 : 0;
+            state[w] = ((s & step[w]) << 1) | carry | (s & loop[w]);
+            alive |= state[w];
+        }
+        if (alive == 0) return false;
+        str__glob_close(glob, state);
+    }
+    return true;
+}
+
+bool str_glob_match(const str_glob *glob, str string, uint64_t *scratch)
+{
+    if (glob == NULL || glob->count == 0) return false;
+    uint64_t stack[STR_GLOB_STACK_WORDS];
+    uint64_t *state = str__glob_scratch(glob, scratch, stack);
+    if (state == NULL || !str__glob_run(glob, string, state)) return false;
+    for (size_t k=0; k<glob->count; ++k){
+        size_t f = glob->finals[k];
+        if (state[f>>6] & ((uint64_t)1 << (f&63))) return true;
+    }
+    return false;
+}
+
+size_t str_glob_match_set(const str_glob *glob, str string, uint64_t *scratch, size_t *ids, size_t max_ids)
+{
+    if (glob == NULL || glob->count == 0) return 0;
+    uint64_t stack[STR_GLOB_STACK_WORDS];
+    uint64_t *state = str__glob_scratch(glob, scratch, stack);
+    if (state == NULL || !str__glob_run(glob, string, state)) return 0;
+    size_t n = 0;
+    for (size_t k=0; k<glob->count; ++k){
+        size_t f = glob->finals[k];
+        if (state[f>>6] & ((uint64_t)1 << (f&63))){
+            if (ids != NULL && n < max_ids) ids[n] = k;
+            n++;
+        }
+    }
+    return n;
+}
+
 void str_print_array(str_array arr)
 {
     putchar('{');
@@ -827,6 +2326,46 @@ void str_free_array(str_array array, Deallocator dealloc)
     dealloc(array.items);
 }
 
+void str_free_buf(str_buf buf)
+{
+    str__assert_deallocator(buf.dealloc);
+    str__free(buf, buf.dealloc);
+}
+
+void str_free_pack(str_pack pack)
+{
+    if (pack.dealloc == NULL) return;
+    if (pack.data != NULL) pack.dealloc(pack.data);
+    if (pack.offsets != NULL) pack.dealloc(pack.offsets);
+}
+
+void str_free_prefix_index(str_prefix_index index, Deallocator dealloc)
+{
+    str__assert_deallocator(dealloc);
+    if (index.items != NULL) dealloc(index.items);
+    if (index.parent != NULL) dealloc(index.parent);
+}
+
+void str_free_pipeline(str_pipeline pipeline)
+{
+    str__assert_deallocator(pipeline.dealloc);
+    for (size_t i=0; i<pipeline.count; ++i){
+        str_pipeline_stage stage = pipeline.stages[i];
+        str__free(stage.a, pipeline.dealloc);
+        str__free(stage.b, pipeline.dealloc);
+        if (stage.fail != NULL) pipeline.dealloc(stage.fail);
+        if (stage.held != NULL) pipeline.dealloc(stage.held);
+    }
+    if (pipeline.stages != NULL) pipeline.dealloc(pipeline.stages);
+}
+
+void str_free_glob(str_glob glob, Deallocator dealloc)
+{
+    str__assert_deallocator(dealloc);
+    if (glob.step != NULL) dealloc(glob.step);
+    if (glob.finals != NULL) dealloc(glob.finals);
+}
+
 void* str__alloc(Allocator alloc, size_t n)
 {
     void *p = alloc(n);
@@ -835,4 +2374,14 @@ void* str__alloc(Allocator alloc, size_t n)
     return p;
 }
 
+void* str__realloc(Allocator alloc, Deallocator dealloc, void *p, size_t n, size_t new_n)
+{
+    void *q = str__alloc(alloc, new_n);
+    if (p != NULL){
+        strlib_ncpy(p, n < new_n ? n : new_n, q);
+        dealloc(p);
+    }
+    return q;
+}
+
 #endif // STRLIB_IMPLEMENTATION
\ No newline at end of file